@@ -4,6 +4,7 @@
 #include <functional>
 #include <map>
 #include <stack>
+#include <algorithm>
 
 #include <WiFi.h>
 #include <ESPmDNS.h>
@@ -21,6 +22,9 @@
 #include <Wire.h>
 #include <SparkFun_STUSB4500.h>
 
+#include <esp_partition.h>
+#include <Preferences.h>
+
 //#define OLED_DISPLAY
 
 #define INPUT_UP 32
@@ -36,6 +40,55 @@
 #define DISPLAY_WIDTH MODULES*MODULE_WIDTH 
 #define DISPLAY_HEIGHT MODULE_HEIGHT
 
+#define OTA_POLL_MS 20
+#define OTA_PROGRESS_INTERVAL_MS (MODULE_WIDTH * MODULE_HEIGHT * DOT_FLIP_US / 1000) // One full module redraw
+
+#define WIFI_SSID "TALKTALK21516E"
+#define WIFI_PASSWORD "YJ7P49A4"
+#define WIFI_HOSTNAME "Flipdot Display"
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 60000
+
+#define STREAM_PORT 4210
+#define STREAM_JITTER_FRAMES 4
+#define STREAM_JITTER_MS 8 // Below FRAME_PERIOD_MS, a frame is shown on the first or second render tick after it arrives
+#define STREAM_TIMEOUT_MS 2000
+
+#define ANIMATION_PARTITION "anim"
+
+#define DRIVER_FIRMWARE_PARTITION "drvfw"
+#define DRIVER_PAGE_SIZE 64
+#define DRIVER_APP_PAGES 56 // (4096 - 512 byte bootloader) / 64
+#define DRIVER_PAGE_WRITE_MS 8 // Drivers halt while a flash page is written
+#define DRIVER_UPDATE_PASSES 6 // The bus only carries data to the drivers: every page is sent this often, unacknowledged
+#define DRIVER_BOOT_REPEATS 3 // Bootloader entry and start commands, both are ignored where they already took effect
+#define DRIVER_EEPROM_WRITE_MS 5 // Drivers store a calibration byte in about 4ms
+
+#define DRIVER_QUEUE_LENGTH 7 // Frames in flight per driver for timed playback (register 13), its ring of 8 holds 7
+#define DRIVER_QUEUE_AHEAD_MS 250 // Animation frames are queued this long before they play
+#define DRIVER_SYNC_INTERVAL_MS 1000 // Sync beacon period while frames are queued, keeps the driver clocks in step
+
+#define DRIVER_FLIP_ORDER 0 // Register 8 for every driver: 0 columns, 1 interleaved, 2 centre out, 3 DRIVER_CUSTOM_ORDER; | 0x08 sets dots before resetting them
+// #define DRIVER_CUSTOM_ORDER {0, 7, 14, ...} // Register 14: all 35 dots (column * 7 + row) in flip order
+
+#define MAX_SHIFT_STEPS 2 // Register 11 costs two bytes per step, three steps cost as much as sending the columns
+#define SHIFT_RESYNC_FRAMES 64 // Columns are resent this often while modules update by shifts, repairing a lost shift
+
+#define FRAME_PERIOD_MS 16
+#define DOT_FLIP_US 510 // Driver flipTime: 5100 x 100ns
+#define UART_BYTE_US 87 // 10 bits at 115200 baud
+
+#define REFRESH_PERIOD_MS 120000 // Rolling refresh re-pulses every unchanged dot once per period to correct drift, 0 disables
+
+#define PANEL_SAVE_SETTLE_MS 3000 // Panel image must be unchanged this long before it is persisted
+#define PANEL_SAVE_INTERVAL_MS 300000 // Minimum time between NVS writes of the panel image
+
+#define COIL_RESISTANCE_OHMS 24 // Row and column driver path through one coil
+#define POWER_RESERVE_MA 300 // Controller, WiFi and idle driver boards
+#define POWER_FALLBACK_MV 5000 // Type-C default when the STUSB4500 cannot be read
+#define POWER_FALLBACK_MA 1500
+
 #ifdef OLED_DISPLAY
   #include <Adafruit_SSD1306.h>
   Adafruit_SSD1306 oled(128, 32, &Wire, -1);
@@ -53,29 +106,562 @@ enum InputEventType {
   , CENTER_SINGLE
 };
 
+// Column-major 1bpp frame matching the wire format: one byte per column, bit y = row y
+class PackedFrame {
+  public:
+
+    static const uint8_t COLUMN_MASK = (1 << DISPLAY_HEIGHT) - 1;
+    static const uint32_t WORD_MASK = COLUMN_MASK * 0x01010101UL;
+    static const int WORDS = (DISPLAY_WIDTH) / 4;
+    static const int PACKED_BYTES = ((DISPLAY_WIDTH) * DISPLAY_HEIGHT + 7) / 8; // Dense bitstream size, 35 bytes
+
+    union {
+      uint8_t columns[DISPLAY_WIDTH];
+      uint32_t words[WORDS];
+    };
+
+    PackedFrame() {
+      clear();
+    }
+
+    void clear() {
+      memset(columns, 0, sizeof(columns));
+    }
+
+    void fill() {
+      for (int i = 0; i < WORDS; i++) {
+        words[i] = WORD_MASK;
+      }
+    }
+
+    bool getPixel(int x, int y) const {
+      if (x < 0 || x >= DISPLAY_WIDTH || y < 0 || y >= DISPLAY_HEIGHT) {
+        return false;
+      }
+      return bitRead(columns[x], y);
+    }
+
+    void setPixel(int x, int y, bool value) {
+      if (x < 0 || x >= DISPLAY_WIDTH || y < 0 || y >= DISPLAY_HEIGHT) {
+        return;
+      }
+      bitWrite(columns[x], y, value);
+    }
+
+    uint8_t getColumn(int x) const {
+      if (x < 0 || x >= DISPLAY_WIDTH) {
+        return 0;
+      }
+      return columns[x];
+    }
+
+    void setColumn(int x, uint8_t column) {
+      if (x < 0 || x >= DISPLAY_WIDTH) {
+        return;
+      }
+      columns[x] = column & COLUMN_MASK;
+    }
+
+    // Copy width columns from source (starting at sourceX) to this frame (starting at targetX).
+    // Source columns outside the frame read as blank.
+    void blit(const PackedFrame& source, int sourceX, int targetX, int width) {
+      if (targetX < 0) {
+        sourceX -= targetX;
+        width += targetX;
+        targetX = 0;
+      }
+      if (targetX + width > DISPLAY_WIDTH) {
+        width = DISPLAY_WIDTH - targetX;
+      }
+      if (width <= 0) {
+        return;
+      }
+
+      if (sourceX >= 0 && sourceX + width <= DISPLAY_WIDTH) {
+        memmove(&columns[targetX], &source.columns[sourceX], width);
+        return;
+      }
+      for (int i = 0; i < width; i++) {
+        columns[targetX + i] = source.getColumn(sourceX + i);
+      }
+    }
+
+    // Dense bitstream: bit (x * DISPLAY_HEIGHT + y), LSB first
+    void packBits(uint8_t* packed) const {
+      memset(packed, 0, PACKED_BYTES);
+      for (int x = 0; x < DISPLAY_WIDTH; x++) {
+        uint16_t bit = x * DISPLAY_HEIGHT;
+        uint16_t chunk = columns[x] << (bit % 8);
+        packed[bit / 8] |= chunk;
+        if (chunk >> 8) {
+          packed[bit / 8 + 1] |= chunk >> 8;
+        }
+      }
+    }
+
+    void unpackBits(const uint8_t* packed) {
+      for (int x = 0; x < DISPLAY_WIDTH; x++) {
+        uint16_t bit = x * DISPLAY_HEIGHT;
+        uint16_t chunk = packed[bit / 8];
+        if (bit / 8 + 1 < PACKED_BYTES) {
+          chunk |= packed[bit / 8 + 1] << 8;
+        }
+        columns[x] = (chunk >> (bit % 8)) & COLUMN_MASK;
+      }
+    }
+
+    void loadCanvas(GFXcanvas1& canvas) {
+      clear();
+      int width = min((int)canvas.width(), DISPLAY_WIDTH);
+      int height = min((int)canvas.height(), DISPLAY_HEIGHT);
+      for (int x = 0; x < width; x++) {
+        uint8_t column = 0;
+        for (int y = 0; y < height; y++) {
+          column |= canvas.getPixel(x, y) << y;
+        }
+        columns[x] = column;
+      }
+    }
+
+    void shiftLeft(int distance) { // Content moves towards x = 0, blank columns enter on the right
+      if (distance < 0) {
+        shiftRight(-distance);
+        return;
+      }
+      if (distance == 0) {
+        return;
+      }
+      if (distance >= DISPLAY_WIDTH) {
+        clear();
+        return;
+      }
+      memmove(columns, columns + distance, DISPLAY_WIDTH - distance);
+      memset(columns + DISPLAY_WIDTH - distance, 0, distance);
+    }
+
+    void shiftRight(int distance) {
+      if (distance < 0) {
+        shiftLeft(-distance);
+        return;
+      }
+      if (distance == 0) {
+        return;
+      }
+      if (distance >= DISPLAY_WIDTH) {
+        clear();
+        return;
+      }
+      memmove(columns + distance, columns, DISPLAY_WIDTH - distance);
+      memset(columns, 0, distance);
+    }
+
+    void shiftUp(int distance) { // Content moves towards y = 0
+      if (distance < 0) {
+        shiftDown(-distance);
+        return;
+      }
+      if (distance >= DISPLAY_HEIGHT) {
+        clear();
+        return;
+      }
+      uint32_t rowMask = (COLUMN_MASK >> distance) * 0x01010101UL;
+      for (int i = 0; i < WORDS; i++) {
+        words[i] = (words[i] >> distance) & rowMask;
+      }
+    }
+
+    void shiftDown(int distance) {
+      if (distance < 0) {
+        shiftUp(-distance);
+        return;
+      }
+      if (distance >= DISPLAY_HEIGHT) {
+        clear();
+        return;
+      }
+      uint32_t rowMask = ((COLUMN_MASK << distance) & COLUMN_MASK) * 0x01010101UL;
+      for (int i = 0; i < WORDS; i++) {
+        words[i] = (words[i] << distance) & rowMask;
+      }
+    }
+
+    void invert() {
+      for (int i = 0; i < WORDS; i++) {
+        words[i] ^= WORD_MASK;
+      }
+    }
+
+    void maskWith(const PackedFrame& other) {
+      for (int i = 0; i < WORDS; i++) {
+        words[i] &= other.words[i];
+      }
+    }
+
+    void orWith(const PackedFrame& other) {
+      for (int i = 0; i < WORDS; i++) {
+        words[i] |= other.words[i];
+      }
+    }
+
+    void xorWith(const PackedFrame& other) {
+      for (int i = 0; i < WORDS; i++) {
+        words[i] ^= other.words[i];
+      }
+    }
+
+    int countDifferences(const PackedFrame& other) const { // Number of dots that differ
+      int differences = 0;
+      for (int i = 0; i < WORDS; i++) {
+        differences += __builtin_popcount(words[i] ^ other.words[i]);
+      }
+      return differences;
+    }
+
+    bool operator==(const PackedFrame& other) const {
+      return memcmp(words, other.words, sizeof(words)) == 0;
+    }
+
+    bool operator!=(const PackedFrame& other) const {
+      return !(*this == other);
+    }
+};
+
+/*
+Compact frame stream format, one record per frame:
+- 0x00 KEY_FRAME    PackedFrame::PACKED_BYTES bitstream
+- 0x01 DELTA_FRAME  column ops applied to the reference frame
+- 0x02 SHIFT_FRAME  int8 dx, int8 dy, then column ops applied to the reference
+                    shifted left by dx and up by dy
+Column ops: 0b1NNNNNNN skips N + 1 unchanged columns, 0b0VVVVVVV XORs V into the
+current column and advances one. Trailing unchanged columns are omitted.
+The encoder lives in Tools/flipdot_codec.py.
+*/
+class FrameCodec {
+  public:
+
+    enum FrameType {
+        KEY_FRAME = 0
+      , DELTA_FRAME = 1
+      , SHIFT_FRAME = 2
+    };
+
+    static bool needsReference(const uint8_t* record, int length) {
+      return length > 0 && record[0] != KEY_FRAME;
+    }
+
+    // Decode one record into target. Returns the number of bytes consumed, or -1 if the record is malformed.
+    static int decode(const uint8_t* record, int length, const PackedFrame& reference, PackedFrame& target) {
+      if (length < 1) {
+        return -1;
+      }
+
+      int position = 1;
+      switch (record[0]) {
+        case KEY_FRAME:
+          if (length < 1 + PackedFrame::PACKED_BYTES) {
+            return -1;
+          }
+          target.unpackBits(record + 1);
+          return 1 + PackedFrame::PACKED_BYTES;
+
+        case DELTA_FRAME:
+          target = reference;
+          break;
+
+        case SHIFT_FRAME:
+          if (length < 3) {
+            return -1;
+          }
+          target = reference;
+          target.shiftLeft((int8_t)record[1]);
+          target.shiftUp((int8_t)record[2]);
+          position = 3;
+          break;
+
+        default:
+          return -1;
+      }
+
+      int column = 0;
+      while (column < DISPLAY_WIDTH && position < length) {
+        uint8_t op = record[position++];
+        if (op & 0x80) {
+          column += (op & 0x7F) + 1;
+        }
+        else {
+          target.columns[column] ^= op;
+          column ++;
+        }
+      }
+      return position;
+    }
+};
+
+// Per-stage timings of the render pipeline, kept in small rings for percentile reports.
+// Send 'p' over Serial for a summary, 'j' for a JSON dump, 'r' to reset.
+class RenderProfiler {
+  public:
+
+    enum Stage {
+        STAGE_VALIDITY
+      , STAGE_COMPOSE
+      , STAGE_UART
+      , STAGE_FLIP_ESTIMATE
+      , STAGE_FRAME
+      , STAGE_COUNT
+    };
+
+    static const int SAMPLES = 64;
+    static const int BACKLOG_SOURCES = 32; // Scrollers alive at once, each NumberInput is one
+
+  private:
+
+    const char* stageNames[STAGE_COUNT] = {"validity", "compose", "uart", "flip_estimate", "frame"};
+
+    uint32_t samples[STAGE_COUNT][SAMPLES] = {{0}}; // Microseconds
+    uint8_t sampleIndex[STAGE_COUNT] = {0};
+    uint8_t sampleCount[STAGE_COUNT] = {0};
+
+    uint32_t cyclesPerMicrosecond = 240;
+
+    uint32_t uartWindowStart = 0;
+    uint32_t uartWindowBytes = 0;
+
+    int backlogDepth[BACKLOG_SOURCES] = {0};
+    bool backlogInUse[BACKLOG_SOURCES] = {false};
+    portMUX_TYPE backlogLock = portMUX_INITIALIZER_UNLOCKED;
+
+    struct StageSummary {
+      uint32_t p50;
+      uint32_t p99;
+      uint32_t max;
+      int count;
+    };
+
+    StageSummary summarise(Stage stage) {
+      uint32_t sorted[SAMPLES];
+      int count = sampleCount[stage];
+      memcpy(sorted, samples[stage], count * sizeof(uint32_t));
+      std::sort(sorted, sorted + count);
+
+      StageSummary summary = {0, 0, 0, count};
+      if (count > 0) {
+        summary.p50 = sorted[count / 2];
+        summary.p99 = sorted[(count * 99) / 100];
+        summary.max = sorted[count - 1];
+      }
+      return summary;
+    }
+
+  public:
+
+    uint32_t framesRendered = 0;
+    uint32_t framesSkipped = 0;
+    uint32_t uartBytesTotal = 0;
+    uint32_t uartBytesPerSecond = 0;
+    int scrollBacklog = 0; // Deepest scroller queue in the last frame
+    int scrollBacklogMax = 0;
+
+    void begin() {
+      cyclesPerMicrosecond = getCpuFrequencyMhz();
+      uartWindowStart = millis();
+    }
+
+    uint32_t cycles() {
+      return ESP.getCycleCount();
+    }
+
+    // Record the time since startCycles for a stage and return the current cycle count for the next stage
+    uint32_t stageComplete(Stage stage, uint32_t startCycles) {
+      uint32_t now = cycles();
+      recordSample(stage, (now - startCycles) / cyclesPerMicrosecond);
+      return now;
+    }
+
+    void recordSample(Stage stage, uint32_t microseconds) {
+      samples[stage][sampleIndex[stage]] = microseconds;
+      sampleIndex[stage] = (sampleIndex[stage] + 1) % SAMPLES;
+      if (sampleCount[stage] < SAMPLES) {
+        sampleCount[stage] ++;
+      }
+    }
+
+    void frameComplete(uint32_t frameMicroseconds) {
+      recordSample(STAGE_FRAME, frameMicroseconds);
+      framesRendered ++;
+      framesSkipped += frameMicroseconds / (FRAME_PERIOD_MS * 1000);
+
+      int deepest = 0;
+      portENTER_CRITICAL(&backlogLock);
+      for (int source = 0; source < BACKLOG_SOURCES; source++) {
+        if (backlogInUse[source]) {
+          deepest = max(deepest, backlogDepth[source]);
+        }
+      }
+      portEXIT_CRITICAL(&backlogLock);
+      scrollBacklog = deepest;
+      scrollBacklogMax = max(scrollBacklogMax, deepest);
+    }
+
+    void addUartBytes(uint32_t bytes) {
+      uartBytesTotal += bytes;
+      uartWindowBytes += bytes;
+
+      uint32_t now = millis();
+      if (now - uartWindowStart >= 1000) {
+        uartBytesPerSecond = uartWindowBytes * 1000 / (now - uartWindowStart);
+        uartWindowBytes = 0;
+        uartWindowStart = now;
+      }
+    }
+
+    // Each scroller reports its own instruction queue depth under the source it was given, -1 once all are taken
+    int addBacklogSource() {
+      portENTER_CRITICAL(&backlogLock);
+      for (int source = 0; source < BACKLOG_SOURCES; source++) {
+        if (!backlogInUse[source]) {
+          backlogInUse[source] = true;
+          backlogDepth[source] = 0;
+          portEXIT_CRITICAL(&backlogLock);
+          return source;
+        }
+      }
+      portEXIT_CRITICAL(&backlogLock);
+      return -1;
+    }
+
+    void removeBacklogSource(int source) {
+      if (source >= 0) {
+        portENTER_CRITICAL(&backlogLock);
+        backlogInUse[source] = false;
+        portEXIT_CRITICAL(&backlogLock);
+      }
+    }
+
+    void recordBacklog(int source, int depth) {
+      if (source >= 0) {
+        backlogDepth[source] = depth;
+      }
+    }
+
+    void reset() {
+      memset(sampleIndex, 0, sizeof(sampleIndex));
+      memset(sampleCount, 0, sizeof(sampleCount));
+      framesRendered = 0;
+      framesSkipped = 0;
+      uartBytesTotal = 0;
+      scrollBacklogMax = scrollBacklog;
+    }
+
+    void printReport(Print& out) {
+      out.printf("frames %u, skipped %u, uart %u B/s, backlog %d (max %d)\n", framesRendered, framesSkipped, uartBytesPerSecond, scrollBacklog, scrollBacklogMax);
+      for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        StageSummary summary = summarise((Stage)stage);
+        out.printf("  %-14s p50 %6u us  p99 %6u us  max %6u us\n", stageNames[stage], summary.p50, summary.p99, summary.max);
+      }
+    }
+
+    void printJson(Print& out) {
+      out.printf("{\"frames\":%u,\"skipped\":%u,\"uart_bytes\":%u,\"uart_bytes_per_second\":%u,\"backlog\":%d,\"backlog_max\":%d,\"stages\":{",
+        framesRendered, framesSkipped, uartBytesTotal, uartBytesPerSecond, scrollBacklog, scrollBacklogMax);
+      for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        StageSummary summary = summarise((Stage)stage);
+        out.printf("%s\"%s\":{\"p50_us\":%u,\"p99_us\":%u,\"max_us\":%u,\"samples\":%d}",
+          stage ? "," : "", stageNames[stage], summary.p50, summary.p99, summary.max, summary.count);
+      }
+      out.println("}}");
+    }
+
+    void handleCommand(int command, Print& out) {
+      switch (command) {
+        case 'p':
+          printReport(out);
+          break;
+        case 'j':
+          printJson(out);
+          break;
+        case 'r':
+          reset();
+          break;
+      }
+    }
+};
+
+RenderProfiler profiler;
+
 class BufferProducer {
 
-  bool bufferValid = false;
+  uint32_t bufferGeneration = 1;
+  PackedFrame* outputCache = nullptr; // Full-width render() output, allocated on first use
+  uint32_t cachedGeneration = 0;
+
+  protected:
+
+  bool cacheOutput = false; // Set by producers whose render() costs more than the copy out of the cache
 
   public:
 
   bool visibility = false;
   bool focus = false;
 
+    virtual ~BufferProducer() {
+      delete outputCache;
+    }
+
     BufferProducer* getProducer() {
       return this;
     }
 
+    // Content changed, anything rendered from an earlier generation is stale
     void invalidateBuffer() {
-      bufferValid = false;
+      if (++bufferGeneration == 0) {
+        bufferGeneration = 1;
+      }
+    }
+
+    // Changes whenever the output may have changed. 0 means it can change on any frame and is never reused.
+    // Leaves invalidate their own buffer, composites override this to fold in their children's generations.
+    virtual uint32_t generation() {
+      return 0;
+    }
+
+    uint32_t getBufferGeneration() {
+      return bufferGeneration;
     }
 
-    bool getBufferValidity() {
-      return bufferValid;
+    // What parents call instead of render(): reuses the cached output while generation() is unchanged
+    void renderCached(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      uint32_t current = cacheOutput ? generation() : 0;
+      if (current == 0 || sourceX < 0 || sourceX + width > DISPLAY_WIDTH) {
+        render(target, targetX, sourceX, width);
+        return;
+      }
+
+      if (!outputCache) {
+        outputCache = new PackedFrame();
+      }
+      if (current != cachedGeneration) {
+        outputCache->clear();
+        render(*outputCache);
+        cachedGeneration = current;
+      }
+      target.blit(*outputCache, sourceX, targetX, width);
     }
 
     virtual bool getPixel(int, int) = 0;
 
+    // Render columns [sourceX, sourceX + width) into target, starting at targetX.
+    // Producers holding packed content override this to avoid per-pixel calls.
+    virtual void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      for (int i = 0; i < width; i++) {
+        uint8_t column = 0;
+        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+          column |= getPixel(sourceX + i, y) << y;
+        }
+        target.setColumn(targetX + i, column);
+      }
+    }
+
     virtual bool ensureBufferValidity(bool) = 0;
 
     virtual bool handleInput(InputEventType) = 0;
@@ -140,10 +726,23 @@ class BufferConsumer {
       }
     }
 
+    void render(PackedFrame& target) {
+      if (bufferProducer) {
+        bufferProducer->renderCached(target);
+      }
+      else {
+        target.clear();
+      }
+    }
+
     void bindToProducer(BufferProducer* buffer) {
       bufferProducer = buffer;
     }
 
+    BufferProducer* boundProducer() {
+      return bufferProducer;
+    }
+
     void releaseProducer() {
       // TODO:tell producer
       bufferProducer = nullptr;
@@ -190,10 +789,63 @@ class BufferConsumer {
     }
 };
 
+// Defers deletion of producers until no frame can still be reading them. Every frame
+// the renderer starts opens a new epoch; an object retired during epoch N is only
+// deleted once a frame that started after N has completed.
+class FrameReclaimer {
+  struct RetiredProducer {
+    BufferProducer* producer;
+    uint32_t epoch;
+  };
+
+  SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+  uint32_t epoch = 0;
+  std::vector<RetiredProducer> retired;
+
+  public:
+
+    void retire(BufferProducer* producer) {
+      xSemaphoreTake(lock, portMAX_DELAY);
+      retired.push_back({producer, epoch});
+      xSemaphoreGive(lock);
+    }
+
+    uint32_t frameBegin() {
+      xSemaphoreTake(lock, portMAX_DELAY);
+      uint32_t frameEpoch = ++epoch;
+      xSemaphoreGive(lock);
+      return frameEpoch;
+    }
+
+    void frameEnd(uint32_t frameEpoch) {
+      std::vector<BufferProducer*> reclaimable;
+
+      xSemaphoreTake(lock, portMAX_DELAY);
+      for (auto entry = retired.begin(); entry != retired.end(); ) {
+        if ((int32_t)(entry->epoch - frameEpoch) < 0) {
+          reclaimable.push_back(entry->producer);
+          entry = retired.erase(entry);
+        }
+        else {
+          entry ++;
+        }
+      }
+      xSemaphoreGive(lock);
+
+      for (BufferProducer* producer : reclaimable) {
+        delete producer;
+      }
+    }
+};
+
+FrameReclaimer frameReclaimer;
+
 int surfaceNumber = 0;
 
 class StaticBuffer: public BufferProducer {
   GFXcanvas1 buffer;
+  PackedFrame packedBuffer;
+  portMUX_TYPE bufferLock = portMUX_INITIALIZER_UNLOCKED;
 
   public:
     StaticBuffer(String surfaceText = "")
@@ -209,18 +861,46 @@ class StaticBuffer: public BufferProducer {
       else {
         buffer.print(surfaceText);
       }
+      packedBuffer.loadCanvas(buffer);
       surfaceNumber++;
     }
 
     void setText(String surfaceText) {
+      setText(surfaceText.c_str());
+    }
+
+    void setText(const char* surfaceText) {
       buffer.setFont(&Font4x5Fixed);
       buffer.fillScreen(false);
       buffer.setCursor(1, 5);
       buffer.print(surfaceText);
+
+      PackedFrame nextBuffer;
+      nextBuffer.loadCanvas(buffer);
+      portENTER_CRITICAL(&bufferLock);
+      packedBuffer = nextBuffer;
+      invalidateBuffer();
+      portEXIT_CRITICAL(&bufferLock);
+    }
+
+    uint32_t generation() {
+      portENTER_CRITICAL(&bufferLock);
+      uint32_t current = getBufferGeneration();
+      portEXIT_CRITICAL(&bufferLock);
+      return current;
     }
 
     bool getPixel(int x, int y) {
-      return buffer.getPixel(x, y);
+      portENTER_CRITICAL(&bufferLock);
+      bool pixel = packedBuffer.getPixel(x, y);
+      portEXIT_CRITICAL(&bufferLock);
+      return pixel;
+    }
+
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      portENTER_CRITICAL(&bufferLock);
+      target.blit(packedBuffer, sourceX, targetX, width);
+      portEXIT_CRITICAL(&bufferLock);
     }
 
     bool ensureBufferValidity(bool includeInactive = false) {
@@ -234,6 +914,8 @@ class StaticBuffer: public BufferProducer {
 
 class TextSurface: public BufferProducer {
   GFXcanvas1 textBuffer;
+  PackedFrame packedBuffer;
+  portMUX_TYPE bufferLock = portMUX_INITIALIZER_UNLOCKED;
   const GFXfont* font;
   
   public:
@@ -251,6 +933,7 @@ class TextSurface: public BufferProducer {
       else {
         textBuffer.print(surfaceText);
       }
+      packedBuffer.loadCanvas(textBuffer);
       surfaceNumber++;
     }
 
@@ -259,10 +942,33 @@ class TextSurface: public BufferProducer {
       textBuffer.fillScreen(false);
       textBuffer.setCursor(1, 5);
       textBuffer.print(surfaceText);
+
+      PackedFrame nextBuffer;
+      nextBuffer.loadCanvas(textBuffer);
+      portENTER_CRITICAL(&bufferLock);
+      packedBuffer = nextBuffer;
+      invalidateBuffer();
+      portEXIT_CRITICAL(&bufferLock);
+    }
+
+    uint32_t generation() {
+      portENTER_CRITICAL(&bufferLock);
+      uint32_t current = getBufferGeneration();
+      portEXIT_CRITICAL(&bufferLock);
+      return current;
     }
 
     bool getPixel(int x, int y) {
-      return textBuffer.getPixel(x, y);
+      portENTER_CRITICAL(&bufferLock);
+      bool pixel = packedBuffer.getPixel(x, y);
+      portEXIT_CRITICAL(&bufferLock);
+      return pixel;
+    }
+
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      portENTER_CRITICAL(&bufferLock);
+      target.blit(packedBuffer, sourceX, targetX, width);
+      portEXIT_CRITICAL(&bufferLock);
     }
 
     bool ensureBufferValidity(bool includeInactive = false) {
@@ -274,18 +980,221 @@ class TextSurface: public BufferProducer {
     }
 };
 
+/*
+Plays a FrameCodec encoded reel straight out of a memory mapped flash partition.
+Partition image, built by Tools/flipdot_anim.py:
+- "FDA1"                 magic
+- uint32 recordBytes     length of the record area
+- uint8 flags            bit 0: loop
+- 3 bytes reserved
+- records                uint16 duration_ms, uint16 length, FrameCodec record
+*/
+class FlashAnimation: public BufferProducer {
+  const char* partitionLabel;
+  spi_flash_mmap_handle_t mapHandle;
+
+  const uint8_t* records = nullptr;
+  uint32_t recordBytes = 0;
+  bool loop = false;
+
+  uint32_t cursor = 0;
+  uint32_t frameDeadline = 0;
+  bool playing = false;
+
+  PackedFrame currentFrame;
+  portMUX_TYPE frameLock = portMUX_INITIALIZER_UNLOCKED;
+
+  static const uint32_t HEADER_BYTES = 12;
+  static const uint32_t RECORD_HEADER_BYTES = 4;
+  static const uint32_t MAX_LAG_MS = 1000;
 
-class SurfaceScrollerImproved: public BufferProducer {
-  private:
-    
-    TaskHandle_t animatorTask;
+  public:
 
-    StaticBuffer emptyBuffer;
+    FlashAnimation(const char* partitionLabel = ANIMATION_PARTITION)
+    : partitionLabel(partitionLabel)
+    {
 
-    BufferProducer* activeBuffer;
-    BufferProducer* inactiveBuffer;
+    }
 
-    int scrollDistance = 0;
+    bool begin() {
+      const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+      if (!partition) {
+        Serial.println("Animation partition not found");
+        return false;
+      }
+
+      const void* mapped;
+      if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &mapped, &mapHandle) != ESP_OK) {
+        Serial.println("Animation partition mmap failed");
+        return false;
+      }
+
+      const uint8_t* image = (const uint8_t*)mapped;
+      if (memcmp(image, "FDA1", 4) != 0) {
+        Serial.println("Animation partition is empty");
+        spi_flash_munmap(mapHandle);
+        return false;
+      }
+
+      uint32_t length;
+      memcpy(&length, image + 4, sizeof(length));
+      if (length > partition->size - HEADER_BYTES) {
+        spi_flash_munmap(mapHandle);
+        return false;
+      }
+
+      records = image + HEADER_BYTES;
+      recordBytes = length;
+      loop = image[8] & 0x01;
+      return true;
+    }
+
+    void restart() {
+      cursor = 0;
+      frameDeadline = millis();
+      playing = records != nullptr;
+    }
+
+    bool isPlaying() {
+      return playing;
+    }
+
+  private:
+
+    // Decode the record at cursor into frame. A looping animation wraps to its start once, until wrapped is cleared
+    bool decodeNext(PackedFrame& frame, uint16_t& duration, bool& wrapped) {
+      for (;;) {
+        if (cursor + RECORD_HEADER_BYTES > recordBytes) {
+          if (loop && cursor > 0 && !wrapped) {
+            cursor = 0;
+            wrapped = true;
+            continue;
+          }
+          if (!loop) {
+            playing = false;
+          }
+          return false;
+        }
+
+        const uint8_t* record = records + cursor;
+        duration = record[0] | (record[1] << 8);
+        uint16_t length = record[2] | (record[3] << 8);
+        if (cursor + RECORD_HEADER_BYTES + length > recordBytes || FrameCodec::decode(record + RECORD_HEADER_BYTES, length, frame, frame) < 0) {
+          playing = false;
+          return false;
+        }
+
+        cursor += RECORD_HEADER_BYTES + length;
+        return true;
+      }
+    }
+
+    void catchUp(uint32_t now) {
+      if ((int32_t)(now - frameDeadline) > (int32_t)MAX_LAG_MS) {
+        frameDeadline = now; // Fell too far behind (e.g. while hidden), don't race to catch up
+      }
+    }
+
+  public:
+
+    // When the next frame is due, in millis(). Only meaningful while playing
+    uint32_t nextDeadline() {
+      catchUp(millis());
+      return frameDeadline;
+    }
+
+    // Decode the next frame without waiting for its deadline, for drivers that queue frames ahead of time.
+    // The animation carries on from there, so rendering afterwards shows the last frame handed out.
+    bool nextFrameAhead(PackedFrame& frame, uint32_t& playAt) {
+      if (!playing) {
+        return false;
+      }
+      catchUp(millis());
+
+      frame = currentFrame;
+      uint16_t duration;
+      bool wrapped = false;
+      if (!decodeNext(frame, duration, wrapped)) {
+        return false;
+      }
+      playAt = frameDeadline;
+      frameDeadline += duration;
+
+      portENTER_CRITICAL(&frameLock);
+      currentFrame = frame;
+      invalidateBuffer();
+      portEXIT_CRITICAL(&frameLock);
+      return true;
+    }
+
+    bool ensureBufferValidity(bool includeInactive = false) {
+      if (!playing) {
+        return true;
+      }
+
+      uint32_t now = millis();
+      catchUp(now);
+
+      PackedFrame nextFrame = currentFrame;
+      bool advanced = false;
+      bool wrapped = false;
+      uint16_t duration;
+      while (playing && (int32_t)(now - frameDeadline) >= 0 && decodeNext(nextFrame, duration, wrapped)) {
+        frameDeadline += duration;
+        advanced = true;
+      }
+
+      if (advanced) {
+        portENTER_CRITICAL(&frameLock);
+        currentFrame = nextFrame;
+        invalidateBuffer();
+        portEXIT_CRITICAL(&frameLock);
+      }
+      return true;
+    }
+
+    uint32_t generation() {
+      portENTER_CRITICAL(&frameLock);
+      uint32_t current = getBufferGeneration();
+      portEXIT_CRITICAL(&frameLock);
+      return current;
+    }
+
+    bool getPixel(int x, int y) {
+      return currentFrame.getPixel(x, y);
+    }
+
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      portENTER_CRITICAL(&frameLock);
+      target.blit(currentFrame, sourceX, targetX, width);
+      portEXIT_CRITICAL(&frameLock);
+    }
+
+    bool handleInput(InputEventType inputEventType) {
+      return false;
+    }
+};
+
+FlashAnimation flashAnimation;
+
+// Runs a lifecycle callback on the UI task, defined with UiQueue below
+void postLifecycle(std::function<void()> callback);
+
+class SurfaceScrollerImproved: public BufferProducer {
+  private:
+    
+    TaskHandle_t animatorTask;
+
+    StaticBuffer emptyBuffer;
+
+    BufferProducer* activeBuffer;
+    BufferProducer* inactiveBuffer;
+
+    int scrollDistance = 0;
+
+    SemaphoreHandle_t queueLock = xSemaphoreCreateMutex(); // Guards instructionBuffer
+    int backlogSource = profiler.addBacklogSource();
+    portMUX_TYPE stateLock = portMUX_INITIALIZER_UNLOCKED; // Guards frameState
 
   public:
 
@@ -297,6 +1206,16 @@ class SurfaceScrollerImproved: public BufferProducer {
 
     std::vector<ScrollInstruction> instructionBuffer;
 
+    // Everything the renderer needs to composite one frame, published by the animator
+    // as a whole so a frame never mixes state from two animation steps
+    struct ScrollState {
+      BufferProducer* active;
+      BufferProducer* inactive;
+      int offset;
+      int distance;
+      bool scrolling;
+    };
+
     void setFrame(BufferProducer* buffer) {
       if (inactiveBuffer) {
         inactiveBuffer->exitFocus();
@@ -313,11 +1232,78 @@ class SurfaceScrollerImproved: public BufferProducer {
       activeBuffer->enterFocus();
 
       offset = 0;
+      xSemaphoreTake(queueLock, portMAX_DELAY);
       instructionBuffer.clear();
+      profiler.recordBacklog(backlogSource, 0);
+      xSemaphoreGive(queueLock);
+      publishState(false);
+    }
+
+    int pendingInstructions() {
+      xSemaphoreTake(queueLock, portMAX_DELAY);
+      int pending = instructionBuffer.size();
+      xSemaphoreGive(queueLock);
+      return pending;
     }
 
   private:
 
+    ScrollState frameState;
+
+    // What the output was last built from, only touched by the renderer through generation()
+    BufferProducer* generationSource = nullptr;
+    uint32_t sourceGeneration = 0;
+
+    void publishState(bool scrolling) {
+      ScrollState state;
+      state.active = activeBuffer;
+      state.inactive = inactiveBuffer;
+      state.offset = offset;
+      state.distance = scrollDistance;
+      state.scrolling = scrolling;
+
+      portENTER_CRITICAL(&stateLock);
+      frameState = state;
+      portEXIT_CRITICAL(&stateLock);
+    }
+
+    ScrollState snapshotState() {
+      portENTER_CRITICAL(&stateLock);
+      ScrollState state = frameState;
+      portEXIT_CRITICAL(&stateLock);
+      return state;
+    }
+
+    static uint32_t rowMask(int rows) { // Rows [0, rows) set in every column of a word
+      rows = constrain(rows, 0, DISPLAY_HEIGHT);
+      return ((1UL << rows) - 1) * 0x01010101UL;
+    }
+
+    // Combine full-height renders of both buffers into the vertically scrolled image
+    static void mergeVertical(PackedFrame& merged, const PackedFrame& active, const PackedFrame& inactive, int offset, int distance) {
+      if (offset >= 0) {
+        int split = distance - offset; // First row taken from the inactive buffer
+        uint32_t activeMask = rowMask(min(split, DISPLAY_HEIGHT - offset));
+        uint32_t inactiveMask = PackedFrame::WORD_MASK & ~rowMask(split);
+        for (int i = 0; i < PackedFrame::WORDS; i++) {
+          uint32_t activeRows = offset < DISPLAY_HEIGHT ? (active.words[i] >> offset) & activeMask : 0;
+          uint32_t inactiveRows = split < DISPLAY_HEIGHT ? (inactive.words[i] << split) & inactiveMask : 0;
+          merged.words[i] = activeRows | inactiveRows;
+        }
+      }
+      else {
+        int split = -offset; // First row taken from the active buffer
+        int inactiveShift = distance - split;
+        uint32_t activeMask = PackedFrame::WORD_MASK & ~rowMask(split);
+        uint32_t inactiveMask = rowMask(min(split, DISPLAY_HEIGHT - inactiveShift));
+        for (int i = 0; i < PackedFrame::WORDS; i++) {
+          uint32_t activeRows = split < DISPLAY_HEIGHT ? (active.words[i] << split) & activeMask : 0;
+          uint32_t inactiveRows = inactiveShift < DISPLAY_HEIGHT ? (inactive.words[i] >> inactiveShift) & inactiveMask : 0;
+          merged.words[i] = activeRows | inactiveRows;
+        }
+      }
+    }
+
     int getRemainingDistance() {
       int remainingDistance = 0;
       bool scrollDirection = instructionBuffer[0].direction;
@@ -327,7 +1313,7 @@ class SurfaceScrollerImproved: public BufferProducer {
       while(searchIndex < instructionBuffer.size()) {
         remainingDistance += instructionBuffer[searchIndex].distance;
         searchIndex ++;
-        if (instructionBuffer[searchIndex].direction != scrollDirection) {
+        if (searchIndex < instructionBuffer.size() && instructionBuffer[searchIndex].direction != scrollDirection) {
           break;
         }
       }
@@ -335,6 +1321,31 @@ class SurfaceScrollerImproved: public BufferProducer {
       return remainingDistance;
     }
 
+    // Drop intermediate same-direction instructions once the backlog grows past
+    // coalesceThreshold, so held inputs don't queue up animations the display can
+    // never catch up with. The last instruction of the run is always kept so the
+    // scroller still lands on the correct final surface.
+    void coalesceInstructions() {
+      int runLength = 1;
+      while (runLength < instructionBuffer.size() && instructionBuffer[runLength].direction == instructionBuffer[0].direction) {
+        runLength ++;
+      }
+
+      if (runLength <= coalesceThreshold) {
+        return;
+      }
+
+      int target = runLength - 1;
+      if (instructionBuffer[target].buffer == activeBuffer) {
+        target --; // Never scroll a surface onto itself
+      }
+
+      for (int i = 0; i < target; i++) {
+        instructionSkipped(instructionBuffer[i]);
+      }
+      instructionBuffer.erase(instructionBuffer.begin(), instructionBuffer.begin() + target);
+    }
+
     int offset = 0;
     bool vertical;
 
@@ -344,7 +1355,9 @@ class SurfaceScrollerImproved: public BufferProducer {
       for(;;) {   
         bool animating = false;
 
+        xSemaphoreTake(scroller->queueLock, portMAX_DELAY);
         if (scroller->instructionBuffer.size() > 0 && scroller->instructionBuffer[0].buffer) {
+          scroller->coalesceInstructions();
           scroller->instructionBegin();
           animating = true;
           bool instructionComplete = false;
@@ -352,11 +1365,17 @@ class SurfaceScrollerImproved: public BufferProducer {
           int remainingDistance = scroller->getRemainingDistance();
 
           ScrollInstruction workingScrollInstruction = scroller->instructionBuffer[0];
+          xSemaphoreGive(scroller->queueLock);
+
           scroller->inactiveBuffer = workingScrollInstruction.buffer;
-          scroller->inactiveBuffer->enterVisibility();
-          if(!animating){
-            scroller->activeBuffer->exitFocus();
-          }
+          scroller->scrollDistance = workingScrollInstruction.distance;
+          scroller->publishState(true);
+          BufferProducer* entering = scroller->inactiveBuffer;
+          BufferProducer* leaving = scroller->activeBuffer;
+          postLifecycle([entering, leaving]() {
+            entering->enterVisibility();
+            leaving->exitFocus(); // Focus returns once the scroll lands with nothing left to do
+          });
           while(!instructionComplete) {
             if(workingScrollInstruction.direction) {
               scroller->offset ++;
@@ -364,29 +1383,44 @@ class SurfaceScrollerImproved: public BufferProducer {
             else {
               scroller->offset --;
             }
+            scroller->publishState(true);
+
+            xSemaphoreTake(scroller->queueLock, portMAX_DELAY);
             remainingDistance = scroller->getRemainingDistance() - abs(scroller->offset);
+            xSemaphoreGive(scroller->queueLock);
 
             vTaskDelay(constrain(100.0/pow(remainingDistance, 1), 10, 200)/portTICK_PERIOD_MS);
 
             if(abs(scroller->offset) == workingScrollInstruction.distance) {
 
-              scroller->activeBuffer->exitVisibility();
-              scroller->activeBuffer = workingScrollInstruction.buffer;
-              if(remainingDistance == 0) {
-                scroller->activeBuffer->enterFocus();
-              }
+              BufferProducer* left = scroller->activeBuffer;
+              BufferProducer* landed = workingScrollInstruction.buffer;
+              bool settled = remainingDistance == 0;
+              postLifecycle([left, landed, settled]() {
+                left->exitVisibility();
+                if (settled) {
+                  landed->enterFocus();
+                }
+              });
+              scroller->activeBuffer = landed;
 
               scroller->inactiveBuffer = &(scroller->emptyBuffer);
+              scroller->offset = 0;
+              scroller->publishState(false);
 
               instructionComplete = true;
 
             }
           }
+          xSemaphoreTake(scroller->queueLock, portMAX_DELAY);
           scroller->instructionComplete();
           scroller->instructionBuffer.erase(scroller->instructionBuffer.begin());
+          profiler.recordBacklog(scroller->backlogSource, scroller->instructionBuffer.size());
+          xSemaphoreGive(scroller->queueLock);
           animating = false;
         }
         else {
+          xSemaphoreGive(scroller->queueLock);
           vTaskDelay(10/portTICK_PERIOD_MS );
         }
       }
@@ -430,6 +1464,13 @@ class SurfaceScrollerImproved: public BufferProducer {
       );
     }
 
+    virtual ~SurfaceScrollerImproved() {
+      vTaskDelete(animatorTask);
+      vSemaphoreDelete(queueLock);
+      profiler.removeBacklogSource(backlogSource);
+    }
+
+    // Instruction hooks run on the animator task with queueLock held
     virtual void instructionComplete() {
 
     }
@@ -438,44 +1479,89 @@ class SurfaceScrollerImproved: public BufferProducer {
 
     }
 
+    virtual void instructionSkipped(ScrollInstruction skippedInstruction) {
+
+    }
+
+    int coalesceThreshold = 2; // Same-direction instructions queued before intermediates are skipped
+
+  protected:
+
+    bool isReferenced(BufferProducer* buffer) { // Caller must hold queueLock
+      if (buffer == activeBuffer || buffer == inactiveBuffer) {
+        return true;
+      }
+      for (ScrollInstruction& instruction : instructionBuffer) {
+        if (instruction.buffer == buffer) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+  public:
+
     bool getPixel(int x, int y) {
-      if(instructionBuffer.size() == 0) {
-        return activeBuffer->getPixel(x, y);
+      ScrollState state = snapshotState();
+      if (!state.scrolling) {
+        return state.active->getPixel(x, y);
       }
 
-      int* positionOffset;
-      if (vertical) {
-        positionOffset = &y;
+      int position = state.offset + (vertical ? y : x);
+      if (position < 0 || position >= state.distance) {
+        position += (state.offset >= 0) ? -state.distance : state.distance;
+        return vertical ? state.inactive->getPixel(x, position) : state.inactive->getPixel(position, y);
       }
-      else {
-        positionOffset = &x;
+      return vertical ? state.active->getPixel(x, position) : state.active->getPixel(position, y);
+    }
+
+    // Settled on one surface the output only changes with that surface, every scroll step is new
+    uint32_t generation() {
+      ScrollState state = snapshotState();
+      uint32_t activeGeneration = state.active->generation();
+      if (state.scrolling || activeGeneration == 0) {
+        generationSource = nullptr;
+        return 0;
       }
+      if (state.active != generationSource || activeGeneration != sourceGeneration) {
+        generationSource = state.active;
+        sourceGeneration = activeGeneration;
+        invalidateBuffer();
+      }
+      return getBufferGeneration();
+    }
 
-      if ((offset + *positionOffset) >= 0 && (offset + *positionOffset) < instructionBuffer[0].distance) {
-        if (vertical) {
-          return activeBuffer->getPixel(x, (offset + y));
-        }
-        else {
-          return activeBuffer->getPixel((offset + x), y);
-        }
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      ScrollState state = snapshotState();
+      if (!state.scrolling) {
+        state.active->renderCached(target, targetX, sourceX, width);
+        return;
       }
-      else {
-        if (vertical) {
-          if (offset >= 0) {
-            return inactiveBuffer->getPixel(x, (offset + y)-instructionBuffer[0].distance);
-          }
-          else {
-            return inactiveBuffer->getPixel(x, (offset + y)+instructionBuffer[0].distance);
-          }
-        }
-        else {
-          if (offset >= 0) {
-            return inactiveBuffer->getPixel((offset + x)-instructionBuffer[0].distance, y);
-          }
-          else {
-            return inactiveBuffer->getPixel((offset + x)+instructionBuffer[0].distance, y);
-          }
-        }
+
+      if (vertical) {
+        PackedFrame activeFrame;
+        PackedFrame inactiveFrame;
+        state.active->renderCached(activeFrame, targetX, sourceX, width);
+        state.inactive->renderCached(inactiveFrame, targetX, sourceX, width);
+        mergeVertical(activeFrame, activeFrame, inactiveFrame, state.offset, state.distance);
+        target.blit(activeFrame, targetX, targetX, width);
+        return;
+      }
+
+      // Horizontal: columns [activeStart, activeEnd) come from the active buffer, the rest from the inactive one
+      int activeStart = constrain(-state.offset - sourceX, 0, width);
+      int activeEnd = constrain(state.distance - state.offset - sourceX, activeStart, width);
+      int inactiveShift = (state.offset >= 0) ? -state.distance : state.distance;
+      int position = state.offset + sourceX;
+
+      if (activeStart > 0) {
+        state.inactive->renderCached(target, targetX, position + inactiveShift, activeStart);
+      }
+      if (activeEnd > activeStart) {
+        state.active->renderCached(target, targetX + activeStart, position + activeStart, activeEnd - activeStart);
+      }
+      if (width > activeEnd) {
+        state.inactive->renderCached(target, targetX + activeEnd, position + activeEnd + inactiveShift, width - activeEnd);
       }
     }
 
@@ -492,33 +1578,36 @@ class SurfaceScrollerImproved: public BufferProducer {
     }
 
     void enterVisibility () {
-      if(instructionBuffer.size() > 0) {
+      if(pendingInstructions() > 0) {
         inactiveBuffer->enterVisibility();
       }
       activeBuffer->enterVisibility();
     }
 
     void enterFocus () {
-      if(instructionBuffer.size() == 0) {
+      if(pendingInstructions() == 0) {
         activeBuffer->enterVisibility();
       }
     }
 
     void exitFocus() {
-      if(instructionBuffer.size() == 0) {
+      if(pendingInstructions() == 0) {
         activeBuffer->exitFocus();
       }
     }
 
     void exitVisibility() {
-      if(instructionBuffer.size() > 0) {
+      if(pendingInstructions() > 0) {
         inactiveBuffer->exitVisibility();
       }
       activeBuffer->exitVisibility();
     }
 
     void addScrollInstrction(ScrollInstruction nextScrollInstruction) {
+      xSemaphoreTake(queueLock, portMAX_DELAY);
       instructionBuffer.push_back(nextScrollInstruction);
+      profiler.recordBacklog(backlogSource, instructionBuffer.size());
+      xSemaphoreGive(queueLock);
     }
 
     bool handleInput(InputEventType inputEventType) {
@@ -545,6 +1634,21 @@ public:
     setFrame(&evenNumber);
   }
 
+  void stepScrollerValue(bool direction) {
+    if (direction) {
+      scrollerValue --;
+      if (scrollerValue < 0) {
+        scrollerValue = max;
+      }
+    }
+    else {
+      scrollerValue ++;
+      if (scrollerValue > max) {
+        scrollerValue = 0;
+      }
+    }
+  }
+
   void instructionBegin() {
     ScrollInstruction instruction = instructionBuffer[0];
 
@@ -555,26 +1659,12 @@ public:
       nextSurface = &oddNumber;
     }
 
-    if (instruction.direction) {
-
-      if (scrollerValue == 0) {
-        nextSurface->setText((String)max);
-      }
-      else {
-        nextSurface->setText((String)(scrollerValue - 1));
-      }
+    stepScrollerValue(instruction.direction);
+    nextSurface->setText((String)scrollerValue);
+  }
 
-      scrollerValue --;
-      if (scrollerValue < 0) {
-        scrollerValue = max;
-      }
-    }else {
-      nextSurface->setText((String)((scrollerValue + 1) % (max + 1)));
-      scrollerValue ++;
-      if (scrollerValue > max) {
-        scrollerValue = 0;
-      }
-    }
+  void instructionSkipped(ScrollInstruction skippedInstruction) {
+    stepScrollerValue(skippedInstruction.direction);
   }
 
   bool handleInput(InputEventType inputEventType) {
@@ -676,95 +1766,1397 @@ public:
 
 };
 
+class CompositeSurface: public BufferProducer {
+public:
 
-class FlipDisplay {
+  enum BlendOp {
+      BLEND_REPLACE
+    , BLEND_OR
+    , BLEND_AND
+    , BLEND_XOR
+  };
+
+  struct Layer {
+    BufferProducer* producer;
+    int x;
+    int y;
+    int width;
+    int height;
+    int z;
+    BlendOp blendOp;
+  };
+
+private:
 
-  GFXcanvas1 stateBuffer;
+  std::vector<Layer> layers; // Sorted by z, bottom layer first
+  std::vector<uint32_t> layerGenerations; // Per layer, what the output was last built from
 
-  TaskHandle_t renderTask;
+  uint32_t columnLayers[DISPLAY_WIDTH] = {0}; // Bitmask of layers drawn in each column
+
+  void rebuildColumnLookup() {
+    layerGenerations.assign(layers.size(), 0);
+    invalidateBuffer();
+    for (int x = 0; x < DISPLAY_WIDTH; x++) {
+      uint32_t mask = 0;
+      for (int i = 0; i < (int)layers.size(); i++) {
+        const Layer& layer = layers[i];
+        if (x < layer.x || x >= layer.x + layer.width) {
+          continue;
+        }
+        // An opaque full-height layer hides everything beneath it
+        if (layer.blendOp == BLEND_REPLACE && layer.y <= 0 && layer.y + layer.height >= DISPLAY_HEIGHT) {
+          mask = 0;
+        }
+        mask |= (uint32_t)1 << i;
+      }
+      columnLayers[x] = mask;
+    }
+  }
+
+public:
+
+  CompositeSurface() {
+    cacheOutput = true;
+  }
+
+  bool addLayer(BufferProducer* producer, int x, int y, int width, int height, int z = 0, BlendOp blendOp = BLEND_REPLACE) {
+    if (layers.size() >= 32) {
+      return false;
+    }
+
+    Layer layer = {producer, x, y, width, height, z, blendOp};
+    auto position = layers.begin();
+    while (position != layers.end() && position->z <= z) {
+      position ++;
+    }
+    layers.insert(position, layer);
+
+    rebuildColumnLookup();
+    return true;
+  }
+
+  void removeLayer(BufferProducer* producer) {
+    for (auto layer = layers.begin(); layer != layers.end(); ) {
+      if (layer->producer == producer) {
+        layer = layers.erase(layer);
+      }
+      else {
+        layer ++;
+      }
+    }
+    rebuildColumnLookup();
+  }
+
+  bool getPixel(int x, int y) {
+    if (x < 0 || x >= DISPLAY_WIDTH) {
+      return false;
+    }
+
+    bool pixel = false;
+    uint32_t mask = columnLayers[x];
+    while (mask) {
+      const Layer& layer = layers[__builtin_ctz(mask)];
+      mask &= mask - 1;
+
+      if (y < layer.y || y >= layer.y + layer.height) {
+        continue;
+      }
+
+      bool layerPixel = layer.producer->getPixel(x - layer.x, y - layer.y);
+      switch (layer.blendOp) {
+        case BLEND_REPLACE:
+          pixel = layerPixel;
+          break;
+        case BLEND_OR:
+          pixel |= layerPixel;
+          break;
+        case BLEND_AND:
+          pixel &= layerPixel;
+          break;
+        case BLEND_XOR:
+          pixel ^= layerPixel;
+          break;
+      }
+    }
+    return pixel;
+  }
+
+  void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+    PackedFrame composed;
+    PackedFrame layerFrame;
+
+    uint32_t visibleLayers = 0;
+    for (int x = max(sourceX, 0); x < min(sourceX + width, DISPLAY_WIDTH); x++) {
+      visibleLayers |= columnLayers[x];
+    }
+
+    while (visibleLayers) {
+      const Layer& layer = layers[__builtin_ctz(visibleLayers)];
+      visibleLayers &= visibleLayers - 1;
+
+      int startX = max(max(layer.x, sourceX), 0);
+      int endX = min(min(layer.x + layer.width, sourceX + width), DISPLAY_WIDTH);
+      if (startX >= endX) {
+        continue;
+      }
+
+      layerFrame.clear();
+      layer.producer->renderCached(layerFrame, startX, startX - layer.x, endX - startX);
+      layerFrame.shiftDown(layer.y);
+
+      int topRow = max(layer.y, 0);
+      int bottomRow = min(layer.y + layer.height, DISPLAY_HEIGHT);
+      if (topRow >= bottomRow) {
+        continue;
+      }
+      uint8_t rowMask = ((1 << bottomRow) - 1) & ~((1 << topRow) - 1);
+
+      for (int x = startX; x < endX; x++) {
+        uint8_t layerColumn = layerFrame.columns[x] & rowMask;
+        switch (layer.blendOp) {
+          case BLEND_REPLACE:
+            composed.columns[x] = (composed.columns[x] & ~rowMask) | layerColumn;
+            break;
+          case BLEND_OR:
+            composed.columns[x] |= layerColumn;
+            break;
+          case BLEND_AND:
+            composed.columns[x] &= layerColumn | ~rowMask;
+            break;
+          case BLEND_XOR:
+            composed.columns[x] ^= layerColumn;
+            break;
+        }
+      }
+    }
+
+    target.blit(composed, sourceX, targetX, width);
+  }
+
+  // Only changes when a layer does. Every layer is asked so a moving one is never hidden behind a settled one
+  uint32_t generation() {
+    bool changing = false;
+    for (int i = 0; i < (int)layers.size(); i++) {
+      uint32_t layerGeneration = layers[i].producer->generation();
+      if (layerGeneration == 0) {
+        changing = true;
+      }
+      else if (layerGeneration != layerGenerations[i]) {
+        layerGenerations[i] = layerGeneration;
+        invalidateBuffer();
+      }
+    }
+    return changing ? 0 : getBufferGeneration();
+  }
+
+  bool ensureBufferValidity(bool includeInactive = false) {
+    bool result = true;
+    for (Layer& layer : layers) {
+      result &= layer.producer->ensureBufferValidity(includeInactive);
+    }
+    return result;
+  }
+
+  bool handleInput(InputEventType inputEventType) {
+    return false;
+  }
+
+  void enterVisibility() {
+    for (Layer& layer : layers) {
+      layer.producer->enterVisibility();
+    }
+  }
+
+  void exitVisibility() {
+    for (Layer& layer : layers) {
+      layer.producer->exitVisibility();
+    }
+  }
+};
+
+// Limits how many driver boards flip at once so the coils stay within the negotiated USB-PD current.
+// Each driver fires one coil at a time, so a flipping module draws roughly VBUS / COIL_RESISTANCE_OHMS.
+class PowerScheduler {
+  struct Lane {
+    uint32_t freeAt;  // micros()
+    int module;       // Module last scheduled on this lane, -1 if none
+  };
+
+  uint32_t busyUntil[MODULES] = {0};  // micros() when each module's last sequence ends
+  int maxFlipping = MODULES;
+
+  static bool before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+  }
+
+  public:
+
+    int supplyMillivolts = POWER_FALLBACK_MV;
+    int supplyMilliamps = POWER_FALLBACK_MA;
+
+    void begin(STUSB4500& pd) {
+      if (pd.begin()) {
+        pd.read();
+        uint8_t pdo = pd.getPdoNumber();
+        supplyMillivolts = pd.getVoltage(pdo) * 1000;
+        supplyMilliamps = pd.getCurrent(pdo) * 1000;
+      }
+      setLimit(supplyMillivolts, supplyMilliamps);
+    }
+
+    void setLimit(int millivolts, int milliamps) {
+      int coilMilliamps = max(1, millivolts / COIL_RESISTANCE_OHMS);
+      maxFlipping = constrain((milliamps - POWER_RESERVE_MA) / coilMilliamps, 1, MODULES);
+    }
+
+    int getMaxFlipping() {
+      return maxFlipping;
+    }
+
+    // Choose a commit time for each module with changed dots so no more than maxFlipping modules pulse at once.
+    // Longest sequences are placed first, each on the lane that frees up earliest. Returns when the last module finishes.
+    uint32_t schedule(const int changedDots[MODULES], uint32_t now, uint32_t commitAt[MODULES]) {
+      Lane lanes[MODULES];
+      int laneCount = 0;
+      for (int module = 0; module < MODULES; module ++) {
+        if (before(now, busyUntil[module]) && laneCount < maxFlipping) {
+          lanes[laneCount++] = {busyUntil[module], module};
+        }
+      }
+      while (laneCount < maxFlipping) {
+        lanes[laneCount++] = {now, -1};
+      }
+
+      int order[MODULES];
+      for (int module = 0; module < MODULES; module ++) {
+        order[module] = module;
+      }
+      std::sort(order, order + MODULES, [&](int a, int b) { return changedDots[a] > changedDots[b]; });
+
+      uint32_t finished = now;
+      for (int module : order) {
+        commitAt[module] = now;
+        if (changedDots[module] == 0) {
+          continue;
+        }
+
+        Lane* lane = &lanes[0];
+        for (int i = 0; i < laneCount; i++) {
+          if (lanes[i].module == module) { // A module still flipping holds its own lane
+            lane = &lanes[i];
+            break;
+          }
+          if (before(lanes[i].freeAt, lane->freeAt)) {
+            lane = &lanes[i];
+          }
+        }
+
+        uint32_t start = lane->freeAt;
+        if (before(start, busyUntil[module])) {
+          start = busyUntil[module];  // The driver holds a commit until its current sequence ends
+        }
+        commitAt[module] = start;
+        busyUntil[module] = start + UART_BYTE_US + changedDots[module] * DOT_FLIP_US;
+        *lane = {busyUntil[module], module};
+        if (before(finished, busyUntil[module])) {
+          finished = busyUntil[module];
+        }
+      }
+      return finished;
+    }
+
+    static void waitUntil(uint32_t deadline) {
+      int32_t remaining = deadline - micros();
+      if (remaining > 2000) {
+        vTaskDelay((remaining - 1000) / 1000 / portTICK_PERIOD_MS);
+      }
+      while (before(micros(), deadline));
+    }
+};
+
+PowerScheduler powerScheduler;
+
+// Keeps the last settled panel image in NVS so a restart only flips the dots that differ.
+// Writes are coalesced: only a settled image that differs from the stored one is written, at most once per interval.
+class PanelStore {
+  Preferences preferences;
+  PackedFrame saved;
+  PackedFrame pending;
+  uint32_t pendingSince = 0;
+  uint32_t lastSave = 0;
+  bool hasSaved = false;
+  bool savedCurrent = false; // Mirrors the stored "current" flag
+
+  // The flag is cleared once per save, on the first change after it, so an image the panel has moved on from
+  // is never seeded: its wrong dots would only be corrected by the rolling refresh
+  void markCurrent(bool current) {
+    preferences.putBool("current", current);
+    savedCurrent = current;
+  }
+
+  public:
+
+    // Returns true and fills image if the stored panel image is still what the panel showed at power off
+    bool begin(PackedFrame& image) {
+      preferences.begin("flipdot", false);
+      uint8_t packed[PackedFrame::PACKED_BYTES];
+      if (preferences.getBytesLength("panel") != sizeof(packed) || preferences.getBytes("panel", packed, sizeof(packed)) != sizeof(packed)) {
+        return false;
+      }
+      saved.unpackBits(packed);
+      pending = saved;
+      hasSaved = true;
+      savedCurrent = preferences.getBool("current", false);
+      if (!savedCurrent) {
+        return false;
+      }
+      image = saved;
+      return true;
+    }
+
+    void update(const PackedFrame& current) {
+      uint32_t now = millis();
+      if (current != pending) {
+        pending = current;
+        pendingSince = now;
+        if (savedCurrent && pending != saved) {
+          markCurrent(false);
+        }
+        return;
+      }
+      if (now - pendingSince < PANEL_SAVE_SETTLE_MS) {
+        return;
+      }
+      if (hasSaved && pending == saved) {
+        if (!savedCurrent) { // Back to the stored image only needs the flag, so the save interval doesn't hold it back
+          markCurrent(true);
+        }
+        return;
+      }
+      if (hasSaved && now - lastSave < PANEL_SAVE_INTERVAL_MS) {
+        return;
+      }
+
+      uint8_t packed[PackedFrame::PACKED_BYTES];
+      pending.packBits(packed);
+      preferences.putBytes("panel", packed, sizeof(packed));
+      markCurrent(true);
+      saved = pending;
+      lastSave = now;
+      hasSaved = true;
+    }
+};
+
+PanelStore panelStore;
+
+class FlipDisplay {
+
+  PackedFrame stateBuffer;
+  portMUX_TYPE stateLock = portMUX_INITIALIZER_UNLOCKED;
+  bool seedPending = false;
+  bool stateKnown = true; // False once driver queues were discarded: stateBuffer may hold a frame that never played
+
+  uint8_t flipOrder = DRIVER_FLIP_ORDER;
+  bool flipOrderPending = true; // Drivers start with the column order, the setting goes out ahead of the next frame
+
+  // Register 8, and register 14 for the custom order, to every driver. Caller holds the bus
+  int sendFlipOrder() {
+    int bytesWritten = 0;
+    if (!flipOrderPending) {
+      return 0;
+    }
+    flipOrderPending = false;
+    for (int module = 0; module < MODULES; module ++) {
+      bytesWritten += Serial2.write(0b10001000 | (module << 4));
+      bytesWritten += Serial2.write(flipOrder);
+      #ifdef DRIVER_CUSTOM_ORDER
+        static const uint8_t customOrder[MODULE_WIDTH * MODULE_HEIGHT] = DRIVER_CUSTOM_ORDER;
+        if ((flipOrder & 0x07) == 3) {
+          bytesWritten += Serial2.write(0b10001110 | (module << 4));
+          bytesWritten += Serial2.write(customOrder, sizeof(customOrder));
+        }
+      #endif
+    }
+    return bytesWritten;
+  }
+
+  SemaphoreHandle_t busLock = xSemaphoreCreateMutex(); // Serial2 to the drivers, held per frame or for a firmware update
+  SemaphoreHandle_t composeLock = xSemaphoreCreateMutex(); // Held while the producer tree is traversed, UI commands wait for it
+
+  // Timed playback: frames decoded ahead of time are queued on the drivers, which commit them on their own clocks
+  FlashAnimation* aheadSource = nullptr;
+  BufferProducer* aheadOwner = nullptr; // Bound producer when playback was requested, a rebind (OTA, streams) composes again
+  bool aheadRestart = false;
+  bool aheadActive = false; // Renderer only: the last frame went through the driver queues
+  portMUX_TYPE aheadLock = portMUX_INITIALIZER_UNLOCKED;
+  uint32_t aheadPlayAt[DRIVER_QUEUE_LENGTH]; // Last module commit of each frame in flight, oldest first, millis()
+  int aheadCount = 0;
+  uint32_t lastSync = 0;
+
+  // Register 11 steps taking one module from its current columns to the next, see the driver's shiftDirections
+  struct ShiftPlan {
+    int steps;  // -1 when the columns must be sent, 0 when the module is unchanged
+    uint8_t direction;
+    uint8_t lines[MAX_SHIFT_STEPS];
+  };
+
+  static const uint8_t SHIFT_LEFT = 0, SHIFT_RIGHT = 1, SHIFT_UP = 2, SHIFT_DOWN = 3, SHIFT_COMMIT = 0x04;
+
+  int deltaFrames = SHIFT_RESYNC_FRAMES; // Frames since every module last received its columns
+
+  static uint8_t rowLine(const uint8_t* columns, int row) { // Bit n = column n
+    uint8_t line = 0;
+    for (int x = 0; x < MODULE_WIDTH; x++) {
+      line |= ((columns[x] >> row) & 1) << x;
+    }
+    return line;
+  }
+
+  // Find the fewest shift steps turning current into next for one module, horizontal before vertical
+  static ShiftPlan planShift(const uint8_t* current, const uint8_t* next) {
+    ShiftPlan plan = {0, SHIFT_LEFT, {0}};
+    if (memcmp(current, next, MODULE_WIDTH) == 0) {
+      return plan;
+    }
+
+    for (int steps = 1; steps <= MAX_SHIFT_STEPS; steps ++) {
+      plan.steps = steps;
+      uint8_t keep = (1 << (MODULE_HEIGHT - steps)) - 1;
+      bool left = true, right = true, up = true, down = true;
+      for (int x = 0; x < MODULE_WIDTH; x++) {
+        if (x < MODULE_WIDTH - steps) {
+          left &= next[x] == current[x + steps];
+          right &= next[x + steps] == current[x];
+        }
+        up &= (next[x] & keep) == current[x] >> steps;
+        down &= next[x] >> steps == (current[x] & keep);
+      }
+
+      for (int i = 0; i < steps; i++) { // Lines in the order they are shifted in
+        if (left) {
+          plan.direction = SHIFT_LEFT;
+          plan.lines[i] = next[MODULE_WIDTH - steps + i];
+        }
+        else if (right) {
+          plan.direction = SHIFT_RIGHT;
+          plan.lines[i] = next[steps - 1 - i];
+        }
+        else if (up) {
+          plan.direction = SHIFT_UP;
+          plan.lines[i] = rowLine(next, MODULE_HEIGHT - steps + i);
+        }
+        else if (down) {
+          plan.direction = SHIFT_DOWN;
+          plan.lines[i] = rowLine(next, steps - 1 - i);
+        }
+      }
+      if (left || right || up || down) {
+        return plan;
+      }
+    }
+    plan.steps = -1;
+    return plan;
+  }
+
+  uint8_t refreshCursor = 0; // Next dot (column * 7 + row) to refresh, applied to every module at once
+  uint32_t refreshLast = 0;
+  uint32_t refreshElapsed = 0;
+
+  // Frames that pulse every dot anyway restart the refresh clock
+  void restartRefresh() {
+    refreshLast = millis();
+    refreshElapsed = 0;
+  }
+
+  // Mark the unchanged dots due for a rolling refresh, MODULE_WIDTH * MODULE_HEIGHT steps cover the panel once per REFRESH_PERIOD_MS
+  void collectRefresh(const PackedFrame& nextFrame, PackedFrame& refresh) {
+    refresh.clear();
+    if (REFRESH_PERIOD_MS == 0) {
+      return;
+    }
+
+    const uint32_t stepMs = max(1, REFRESH_PERIOD_MS / (MODULE_WIDTH * MODULE_HEIGHT));
+    uint32_t now = millis();
+    refreshElapsed = min(refreshElapsed + (now - refreshLast), stepMs);  // Don't build up a backlog while the renderer is stalled
+    refreshLast = now;
+
+    for (; refreshElapsed >= stepMs; refreshElapsed -= stepMs) {
+      for (int module = 0; module < MODULES; module ++) {
+        refresh.setPixel(module * MODULE_WIDTH + refreshCursor / MODULE_HEIGHT, refreshCursor % MODULE_HEIGHT, true);
+      }
+      refreshCursor = (refreshCursor + 1) % (MODULE_WIDTH * MODULE_HEIGHT);
+    }
+
+    for (int x = 0; x < DISPLAY_WIDTH; x++) {
+      refresh.columns[x] &= ~(nextFrame.columns[x] ^ stateBuffer.columns[x]);  // Changed dots flip anyway
+    }
+  }
+
+  // Queue frame on the modules it changes. Commits are staggered within the supply budget as transmitFrame does,
+  // but as play ticks: the drivers' 14 bit millisecond clocks set by the sync beacon
+  int queueFrame(const PackedFrame& frame, uint32_t playAt) {
+    int bytesWritten = 0;
+    int changedDots[MODULES];
+    for (int module = 0; module < MODULES; module ++) {
+      changedDots[module] = 0;
+      for (int x = module * MODULE_WIDTH; x < (module + 1) * MODULE_WIDTH; x++) {
+        changedDots[module] += __builtin_popcount(stateKnown ? frame.columns[x] ^ stateBuffer.columns[x] : PackedFrame::COLUMN_MASK);
+      }
+    }
+
+    uint32_t start = micros() + (int32_t)(playAt - millis()) * 1000;
+    uint32_t commitAt[MODULES];
+    powerScheduler.schedule(changedDots, start, commitAt);
+
+    uint32_t lastTick = playAt;
+    for (int module = 0; module < MODULES; module ++) {
+      if (changedDots[module] == 0) {
+        continue;
+      }
+      uint32_t tick = playAt + (commitAt[module] - start + 999) / 1000;
+      bytesWritten += Serial2.write(0b10001101 | (module << 4));
+      bytesWritten += Serial2.write(&frame.columns[module * MODULE_WIDTH], MODULE_WIDTH);
+      bytesWritten += Serial2.write(tick & 0x7F);
+      bytesWritten += Serial2.write((tick >> 7) & 0x7F);
+      if ((int32_t)(tick - lastTick) > 0) {
+        lastTick = tick;
+      }
+    }
+
+    if (bytesWritten > 0) {
+      aheadPlayAt[aheadCount++] = lastTick;
+    }
+    portENTER_CRITICAL(&stateLock);
+    stateBuffer = frame;
+    portEXIT_CRITICAL(&stateLock);
+    stateKnown = true;
+    return bytesWritten;
+  }
+
+  TaskHandle_t renderTask;
+
+  public:
+
+   BufferConsumer frameBuffer;
+
+    FlipDisplay()
+    : frameBuffer()
+    , stateBuffer()
+    {
+      
+    }
+
+    void begin(bool startRenderer = true) {
+      Serial2.begin(115200);
+      while(!Serial2);
+      profiler.begin();
+      if (!startRenderer) {
+        return;
+      }
+      restartRefresh();
+      xTaskCreatePinnedToCore (
+        renderer,
+        "Flip Display Renderer",
+        10000,
+        this,
+        1,
+        &renderTask,
+        1
+      );
+    }
+
+    /*
+    On display update call:
+    - Check validity of required producers
+    - Redraw branches with invalid producers, ending in framebuffer consumer
+    - Draw framebuffer to display
+    */ 
+
+    // Take the dots as already showing image: the drivers are told without pulsing, and only differences flip
+    void seedState(const PackedFrame& image) {
+      portENTER_CRITICAL(&stateLock);
+      stateBuffer = image;
+      seedPending = true;
+      portEXIT_CRITICAL(&stateLock);
+    }
+
+    // Takes effect from the next frame, also used to restore the order once drivers restarted
+    void setFlipOrder(uint8_t order) {
+      acquireBus();
+      flipOrder = order;
+      flipOrderPending = true;
+      releaseBus();
+    }
+
+    uint8_t getFlipOrder() {
+      return flipOrder;
+    }
+
+    // Exclusive use of the driver bus, frames are held back until released
+    void acquireBus() {
+      xSemaphoreTake(busLock, portMAX_DELAY);
+    }
+
+    void releaseBus() {
+      xSemaphoreGive(busLock);
+    }
+
+    // Play source from the driver queues rather than composing frames, nullptr returns to composing.
+    // Whatever the drivers still hold is discarded first, so this also restarts after the source is rewound.
+    void playAhead(FlashAnimation* source) {
+      BufferProducer* owner = frameBuffer.boundProducer();
+      portENTER_CRITICAL(&aheadLock);
+      aheadSource = source;
+      aheadOwner = owner;
+      aheadRestart = true;
+      portEXIT_CRITICAL(&aheadLock);
+    }
+
+    PackedFrame getState() {
+      portENTER_CRITICAL(&stateLock);
+      PackedFrame state = stateBuffer;
+      portEXIT_CRITICAL(&stateLock);
+      return state;
+    }
+
+    int updateDisplay(bool fullRedraw = false) {  //TODO: replace enture display update functionality
+      PackedFrame nextFrame;
+      composeFrame(nextFrame);
+      return transmitFrame(nextFrame, fullRedraw);
+    }
+
+    void composeFrame(PackedFrame& nextFrame) {
+      lockCompose();
+      uint32_t stageStart = profiler.cycles();
+      frameBuffer.ensureBufferValidity();
+      stageStart = profiler.stageComplete(RenderProfiler::STAGE_VALIDITY, stageStart);
+
+      frameBuffer.render(nextFrame);
+      profiler.stageComplete(RenderProfiler::STAGE_COMPOSE, stageStart);
+      unlockCompose();
+    }
+
+    // Keeps changes to the producer tree between frames
+    void lockCompose() {
+      xSemaphoreTake(composeLock, portMAX_DELAY);
+    }
+
+    void unlockCompose() {
+      xSemaphoreGive(composeLock);
+    }
+
+    // Send a composed frame to the driver boards, returning the number of bytes written
+    int transmitFrame(const PackedFrame& nextFrame, bool fullRedraw = false) {
+      acquireBus();
+      uint32_t stageStart = profiler.cycles();
+      int bytesWritten = sendFlipOrder();
+
+      PackedFrame refresh;
+      bool resync = !stateKnown; // Every module gets its columns and a commit, the drivers flip what actually differs
+      stateKnown = true;
+      if (!fullRedraw && !resync) {
+        collectRefresh(nextFrame, refresh);
+      }
+      else if (fullRedraw) {
+        restartRefresh();
+      }
+
+      int changedDots[MODULES];
+      bool refreshing[MODULES];
+      for (int module = 0; module < MODULES; module ++) {
+        changedDots[module] = 0;
+        refreshing[module] = false;
+        for (int x = module * MODULE_WIDTH; x < (module + 1) * MODULE_WIDTH; x++) {
+          changedDots[module] += __builtin_popcount(fullRedraw || resync ? PackedFrame::COLUMN_MASK : (nextFrame.columns[x] ^ stateBuffer.columns[x]) | refresh.columns[x]);
+          refreshing[module] |= refresh.columns[x] != 0;
+        }
+      }
+      portENTER_CRITICAL(&stateLock);
+      PackedFrame seed = stateBuffer;
+      bool seeding = seedPending && !fullRedraw;
+      seedPending = false;
+      stateBuffer = nextFrame;
+      portEXIT_CRITICAL(&stateLock);
+
+      // Modules whose content only moved (marquees, scroll transitions) are sent shift steps instead of their columns
+      bool sendColumns = fullRedraw || seeding || resync || deltaFrames >= SHIFT_RESYNC_FRAMES;
+      deltaFrames = sendColumns ? 0 : deltaFrames + 1;
+      ShiftPlan plans[MODULES];
+      for (int module = 0; module < MODULES; module ++) {
+        plans[module] = sendColumns ? ShiftPlan{-1} : planShift(&seed.columns[module * MODULE_WIDTH], &nextFrame.columns[module * MODULE_WIDTH]);
+      }
+
+      for (int module = 0; module < MODULES; module ++) {
+        if (seeding) {
+          bytesWritten += Serial2.write(0b10001010 | (module << 4));
+          bytesWritten += Serial2.write(&seed.columns[module * MODULE_WIDTH], MODULE_WIDTH);
+        }
+        if (plans[module].steps < 0) {
+          bytesWritten += Serial2.write(0b10000000 | (module << 4));
+          bytesWritten += Serial2.write(&stateBuffer.columns[module * MODULE_WIDTH], MODULE_WIDTH);
+        }
+        if (refreshing[module]) {
+          bytesWritten += Serial2.write(0b10001001 | (module << 4));
+          bytesWritten += Serial2.write(&refresh.columns[module * MODULE_WIDTH], MODULE_WIDTH);
+        }
+      }
+      Serial2.flush();  // Commit timing below assumes the frame data has already arrived
+
+      // Commits are staggered so the modules flipping at once stay within the supply budget
+      uint32_t now = micros();
+      uint32_t commitAt[MODULES];
+      uint32_t finished = powerScheduler.schedule(changedDots, now, commitAt);
+
+      int order[MODULES];
+      for (int module = 0; module < MODULES; module ++) {
+        order[module] = module;
+      }
+      std::sort(order, order + MODULES, [&](int a, int b) { return (int32_t)(commitAt[a] - commitAt[b]) < 0; });
+
+      for (int module : order) {
+        PowerScheduler::waitUntil(commitAt[module]);
+        const ShiftPlan& plan = plans[module];
+        if (fullRedraw) {
+          bytesWritten += Serial2.write(0b10000110 | (module << 4));
+        }
+        else if (plan.steps > 0) {
+          bytesWritten += Serial2.write(0b10001011 | (module << 4));
+          for (int i = 0; i < plan.steps; i++) {
+            bytesWritten += Serial2.write(plan.direction | (i == plan.steps - 1 ? SHIFT_COMMIT : 0)); // Commits with the last step
+            bytesWritten += Serial2.write(plan.lines[i]);
+          }
+        }
+        else {
+          bytesWritten += Serial2.write(0b10000101 | (module << 4));
+        }
+      }
+      profiler.stageComplete(RenderProfiler::STAGE_UART, stageStart);
+      profiler.addUartBytes(bytesWritten);
+      profiler.recordSample(RenderProfiler::STAGE_FLIP_ESTIMATE, finished - now);
+      releaseBus();
+      return bytesWritten;
+    }
+
+    // Keep the driver queues topped up from source, returning the number of bytes written
+    int transmitAhead(FlashAnimation& source, bool restart) {
+      lockCompose(); // UI commands rewind source
+      acquireBus();
+      uint32_t stageStart = profiler.cycles();
+      int bytesWritten = sendFlipOrder();
+      uint32_t now = millis();
+
+      deltaFrames = SHIFT_RESYNC_FRAMES; // Frames played from the queues leave the drivers' columns unknown
+      if (restart) {
+        for (int module = 0; module < MODULES; module ++) {
+          bytesWritten += Serial2.write(0b10000101 | (module << 4)); // Discards the queue, the showing frame commits unchanged
+        }
+        aheadCount = 0;
+        stateKnown = false; // The next frame goes to every module
+      }
+      if (restart || now - lastSync >= DRIVER_SYNC_INTERVAL_MS) {
+        bytesWritten += Serial2.write(0b10001111); // Broadcast register 15: sync beacon
+        bytesWritten += Serial2.write('S');
+        bytesWritten += Serial2.write(now & 0x7F);
+        bytesWritten += Serial2.write((now >> 7) & 0x7F);
+        lastSync = now;
+      }
+
+      // A driver only takes a frame from its queue once the previous sequence ends
+      const uint32_t sequenceMs = MODULE_WIDTH * MODULE_HEIGHT * DOT_FLIP_US / 1000 + 1;
+      int played = 0;
+      while (played < aheadCount && (int32_t)(now - (aheadPlayAt[played] + sequenceMs)) >= 0) {
+        played ++;
+      }
+      aheadCount -= played;
+      memmove(aheadPlayAt, aheadPlayAt + played, aheadCount * sizeof(aheadPlayAt[0]));
+
+      PackedFrame frame;
+      uint32_t playAt;
+      while (aheadCount < DRIVER_QUEUE_LENGTH && source.isPlaying()
+          && (int32_t)(source.nextDeadline() - (now + DRIVER_QUEUE_AHEAD_MS)) <= 0
+          && source.nextFrameAhead(frame, playAt)) {
+        bytesWritten += queueFrame(frame, playAt);
+      }
+
+      profiler.stageComplete(RenderProfiler::STAGE_UART, stageStart);
+      profiler.addUartBytes(bytesWritten);
+      releaseBus();
+      unlockCompose();
+      return bytesWritten;
+    }
+
+    static void renderer(void* pvParameters) {
+      FlipDisplay* flipDisplay = (FlipDisplay*)pvParameters;
+      for (;;){
+        uint32_t frameStart = profiler.cycles();
+        uint32_t frameEpoch = frameReclaimer.frameBegin();
+
+        portENTER_CRITICAL(&flipDisplay->aheadLock);
+        FlashAnimation* ahead = flipDisplay->aheadSource;
+        BufferProducer* owner = flipDisplay->aheadOwner;
+        bool restart = flipDisplay->aheadRestart;
+        flipDisplay->aheadRestart = false;
+        portEXIT_CRITICAL(&flipDisplay->aheadLock);
+
+        bool useAhead = ahead && !fullRedraw && flipDisplay->frameBuffer.boundProducer() == owner;
+        if (useAhead != flipDisplay->aheadActive) { // Switching either way leaves the driver queues and our state stale
+          flipDisplay->aheadActive = useAhead;
+          restart = true;
+        }
+
+        if (useAhead) {
+          flipDisplay->transmitAhead(*ahead, restart);
+        }
+        else {
+          if (restart) {
+            flipDisplay->stateKnown = false; // Leaving timed playback, frames may still have been queued
+          }
+          flipDisplay->updateDisplay(fullRedraw); // Immediate commits also discard anything left in the driver queues
+          fullRedraw = false;
+        }
+        frameReclaimer.frameEnd(frameEpoch);
+
+        #ifdef OLED_DISPLAY
+          for (int x = 0; x < 40; x ++) {
+            for (int y = 0; y < 7; y ++) {
+              oled.drawPixel(x*3, y*3+1, flipDisplay->stateBuffer.getPixel(x, y));
+              oled.drawPixel(x*3+1, y*3, flipDisplay->stateBuffer.getPixel(x, y));
+              oled.drawPixel(x*3+1, y*3+1, flipDisplay->stateBuffer.getPixel(x, y));
+              oled.drawPixel(x*3+1, y*3+2, flipDisplay->stateBuffer.getPixel(x, y));
+              oled.drawPixel(x*3+2, y*3+1, flipDisplay->stateBuffer.getPixel(x, y));
+            }
+          }
+        #endif
+
+        profiler.frameComplete((profiler.cycles() - frameStart) / getCpuFrequencyMhz());
+
+        vTaskDelay(FRAME_PERIOD_MS/portTICK_PERIOD_MS ); // 60 FPS: 16ms/frame
+      }
+    }
+
+    void handleInput(InputEventType InputEventType) {
+      frameBuffer.handleInput(InputEventType);
+    }
+};
+
+FlipDisplay display;
+
+// Reflashes every driver over the bus (Driver Board/Bootloader). The drivers cannot answer, so the image is
+// broadcast DRIVER_UPDATE_PASSES times and each bootloader verifies it before starting it. A driver that still
+// missed a page stays in its bootloader, ignores normal frames and is picked up by the next update.
+// Partition image: "FDB1", uint16 page count, uint16 crc16 of the padded pages, then the pages.
+class DriverUpdater {
+  static const uint32_t HEADER_BYTES = 8;
+
+  static uint16_t crc16(uint16_t crc, uint8_t value) {  // CCITT, as the bootloader
+    crc ^= (uint16_t)value << 8;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+  }
+
+  void sendPage(const uint8_t* pages, int page) {
+    const uint8_t* data = pages + page * DRIVER_PAGE_SIZE;
+    uint16_t crc = crc16(0xFFFF, page);
+    for (int i = 0; i < DRIVER_PAGE_SIZE; i++) {
+      crc = crc16(crc, data[i]);
+    }
+    Serial2.write('P');
+    Serial2.write(page);
+    Serial2.write(data, DRIVER_PAGE_SIZE);
+    Serial2.write(crc & 0xFF);
+    Serial2.write(crc >> 8);
+    Serial2.flush();
+    delay(DRIVER_PAGE_WRITE_MS);
+  }
+
+  public:
+
+    bool run(FlipDisplay& flipDisplay, Print& log) {
+      const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, DRIVER_FIRMWARE_PARTITION);
+      spi_flash_mmap_handle_t mapHandle;
+      const void* mapped;
+      if (!partition || esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &mapped, &mapHandle) != ESP_OK) {
+        log.println("Driver firmware partition not found");
+        return false;
+      }
+
+      const uint8_t* image = (const uint8_t*)mapped;
+      uint16_t pageCount = image[4] | image[5] << 8;
+      uint16_t imageCrc = image[6] | image[7] << 8;
+      if (memcmp(image, "FDB1", 4) != 0 || pageCount == 0 || pageCount > DRIVER_APP_PAGES) {
+        log.println("No driver firmware image");
+        spi_flash_munmap(mapHandle);
+        return false;
+      }
+      const uint8_t* pages = image + HEADER_BYTES;
+
+      flipDisplay.acquireBus();
+      for (int i = 0; i < DRIVER_BOOT_REPEATS; i++) {
+        Serial2.write(0b10001111); // Broadcast register 15: restart into the bootloader
+        Serial2.write('B');
+        Serial2.write('L');
+        Serial2.write(0);
+        Serial2.flush();
+        delay(100);
+      }
+
+      // Pages a bootloader already wrote are skipped there, repeats only cover what got lost
+      for (int pass = 0; pass < DRIVER_UPDATE_PASSES; pass ++) {
+        for (int page = 0; page < pageCount; page ++) {
+          sendPage(pages, page);
+        }
+      }
+
+      for (int i = 0; i < DRIVER_BOOT_REPEATS; i++) {
+        Serial2.write('G'); // The crc goes in 7 bit groups, drivers already running the new image ignore the repeat
+        Serial2.write(pageCount);
+        Serial2.write(imageCrc & 0x7F);
+        Serial2.write((imageCrc >> 7) & 0x7F);
+        Serial2.write(imageCrc >> 14);
+        Serial2.flush();
+        delay(100);
+      }
+
+      fullRedraw = true; // Restarted drivers do not know their dot state
+      flipDisplay.releaseBus();
+      flipDisplay.setFlipOrder(flipDisplay.getFlipOrder()); // Nor their flip order
+      spi_flash_munmap(mapHandle);
+
+      log.printf("Sent %d pages to the drivers %d times. A module that stops updating missed a page, run 'u' again for them\n", pageCount, DRIVER_UPDATE_PASSES);
+      return true;
+    }
+};
+
+DriverUpdater driverUpdater;
+
+// Serial console side of the per-dot pulse calibration (Driver Board/Tools/driver_calibrate.py).
+// A session holds the driver bus so test patterns stay up while the dots are inspected. Lines after 'c':
+//   b                         begin a session
+//   t module length on        flip every dot of module to on (1) or off (0) with the test length
+//   s module dot length       store a dot's length in the driver's EEPROM, 0 = uncalibrated
+//   e                         end the session, the display is redrawn
+// Lengths are in 6.4us units. Each line is answered "ok" or "error".
+class DriverCalibrator {
+  static const uint8_t CALIBRATION_ALL = 127;
+
+  bool session = false;
+
+  static void writeCalibration(int module, uint8_t dot, uint8_t length) {
+    Serial2.write(0b10001100 | (module << 4));
+    Serial2.write(dot);
+    Serial2.write(length);
+    Serial2.flush();
+  }
+
+  static void writeFullRedraw(int module, bool on) {
+    Serial2.write(0b10000000 | (module << 4));
+    for (int x = 0; x < MODULE_WIDTH; x++) {
+      Serial2.write(on ? PackedFrame::COLUMN_MASK : 0);
+    }
+    Serial2.write(0b10000110 | (module << 4));
+    Serial2.flush();
+    delay(MODULE_WIDTH * MODULE_HEIGHT * DOT_FLIP_US / 1000 + 10);
+  }
+
+  public:
+
+    bool handleCommand(const char* line, FlipDisplay& flipDisplay, Print& out) {
+      char command = 0;
+      int module = 0, first = 0, second = 0;
+      int fields = sscanf(line, " %c %d %d %d", &command, &module, &first, &second);
+      bool valid = fields >= 1 && (fields == 1 || (module >= 0 && module < MODULES));
+
+      if (valid && command == 'b' && !session) {
+        flipDisplay.acquireBus();
+        session = true;
+      }
+      else if (valid && command == 't' && session && fields == 4 && first > 0 && first < CALIBRATION_ALL) {
+        writeFullRedraw(module, !second);  // Start from the opposite state with the uncalibrated pulse
+        writeCalibration(module, CALIBRATION_ALL, first);
+        writeFullRedraw(module, second);
+        writeCalibration(module, CALIBRATION_ALL, 0);
+      }
+      else if (valid && command == 's' && session && fields == 4 && first >= 0 && first < MODULE_WIDTH * MODULE_HEIGHT && second >= 0 && second < CALIBRATION_ALL) {
+        writeCalibration(module, first, second);
+        delay(DRIVER_EEPROM_WRITE_MS);
+      }
+      else if (valid && command == 'e' && session) {
+        session = false;
+        fullRedraw = true; // Test patterns replaced whatever the drivers were showing
+        flipDisplay.releaseBus();
+      }
+      else {
+        out.println("error");
+        return false;
+      }
+      out.println("ok");
+      return true;
+    }
+};
+
+DriverCalibrator driverCalibrator;
+
+// Activity lifecycle changes, input and producer binding are posted here from any task and applied by the UI task
+// between frames, so traversing the producer tree for a frame never starts, closes or focuses anything itself
+class UiQueue {
+  using Command = std::function<void()>;
+
+  std::vector<Command> pending;
+  std::vector<Command> applying;
+  SemaphoreHandle_t lock = xSemaphoreCreateMutex(); // Guards pending
+  TaskHandle_t uiTask = nullptr;
+
+  static void worker(void* pvParameters) {
+    UiQueue* queue = (UiQueue*)pvParameters;
+    for (;;) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      queue->apply();
+    }
+  }
+
+  void apply() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    std::swap(pending, applying);
+    xSemaphoreGive(lock);
+
+    display.lockCompose();
+    for (Command& command : applying) {
+      command();
+    }
+    display.unlockCompose();
+    applying.clear();
+  }
+
+  public:
+
+    void begin() {
+      xTaskCreatePinnedToCore (
+        worker,
+        "UI Commands",
+        10000,
+        this,
+        1,
+        &uiTask,
+        1
+      );
+      xTaskNotifyGive(uiTask); // Anything posted during setup
+    }
+
+    void post(Command command) {
+      xSemaphoreTake(lock, portMAX_DELAY);
+      pending.push_back(std::move(command));
+      xSemaphoreGive(lock);
+      if (uiTask) {
+        xTaskNotifyGive(uiTask);
+      }
+    }
+};
+
+UiQueue uiQueue;
+
+void postLifecycle(std::function<void()> callback) {
+  uiQueue.post(std::move(callback));
+}
+
+// Frames pushed from the network, presented through a small jitter buffer
+class StreamSurface: public BufferProducer {
+  struct StreamFrame {
+    PackedFrame frame;
+    uint16_t sequence;
+    uint32_t arrival;
+    bool filled;
+  };
+
+  StreamFrame jitterBuffer[STREAM_JITTER_FRAMES];
+  PackedFrame presentedFrame;
+  PackedFrame lastReceivedFrame;
+
+  uint16_t presentedSequence = 0;
+  uint16_t lastReceivedSequence = 0;
+  bool started = false;
+
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  static bool sequenceAfter(uint16_t a, uint16_t b) {
+    return (int16_t)(a - b) > 0;
+  }
+
+  public:
+
+    uint32_t framesReceived = 0;
+    uint32_t framesDropped = 0;
+
+    StreamSurface() {
+      reset();
+    }
+
+    void reset() {
+      portENTER_CRITICAL(&lock);
+      for (int i = 0; i < STREAM_JITTER_FRAMES; i++) {
+        jitterBuffer[i].filled = false;
+      }
+      started = false;
+      portEXIT_CRITICAL(&lock);
+    }
+
+    // Queue a complete frame. Frames at or before the presented sequence arrive too late and are dropped.
+    bool pushFrame(uint16_t sequence, const PackedFrame& frame) {
+      uint32_t now = millis();
+
+      portENTER_CRITICAL(&lock);
+      if (!started) {
+        presentedSequence = sequence - 1;
+        started = true;
+      }
+
+      if (!sequenceAfter(sequence, presentedSequence)) {
+        framesDropped ++;
+        portEXIT_CRITICAL(&lock);
+        return false;
+      }
+
+      if ((uint16_t)(sequence - presentedSequence) > STREAM_JITTER_FRAMES) {
+        // Sender is too far ahead of us: drop the backlog and resynchronise
+        for (int i = 0; i < STREAM_JITTER_FRAMES; i++) {
+          if (jitterBuffer[i].filled) {
+            framesDropped ++;
+          }
+          jitterBuffer[i].filled = false;
+        }
+        presentedSequence = sequence - 1;
+      }
+
+      StreamFrame& slot = jitterBuffer[sequence % STREAM_JITTER_FRAMES];
+      slot.frame = frame;
+      slot.sequence = sequence;
+      slot.arrival = now;
+      slot.filled = true;
+
+      lastReceivedFrame = frame;
+      lastReceivedSequence = sequence;
+      framesReceived ++;
+      portEXIT_CRITICAL(&lock);
+      return true;
+    }
+
+    // Apply an XOR delta against the previous frame in the sequence
+    bool pushDelta(uint16_t sequence, const PackedFrame& delta) {
+      portENTER_CRITICAL(&lock);
+      bool haveBase = started && (uint16_t)(lastReceivedSequence + 1) == sequence;
+      PackedFrame frame = lastReceivedFrame;
+      if (!haveBase) {
+        framesDropped ++;
+      }
+      portEXIT_CRITICAL(&lock);
+
+      if (!haveBase) {
+        return false;
+      }
+      frame.xorWith(delta);
+      return pushFrame(sequence, frame);
+    }
+
+    bool getLastReceived(uint16_t& sequence, PackedFrame& frame) {
+      portENTER_CRITICAL(&lock);
+      sequence = lastReceivedSequence;
+      frame = lastReceivedFrame;
+      bool valid = started;
+      portEXIT_CRITICAL(&lock);
+      return valid;
+    }
+
+    bool ensureBufferValidity(bool includeInactive = false) {
+      uint32_t now = millis();
+
+      portENTER_CRITICAL(&lock);
+      // Present the newest frame that has aged past the jitter delay. Older ones, and any that never
+      // arrived, are skipped so the panel never trails the stream by more than that delay
+      int newest = 0;
+      for (int step = 1; step <= STREAM_JITTER_FRAMES; step++) {
+        uint16_t sequence = presentedSequence + step;
+        StreamFrame& slot = jitterBuffer[sequence % STREAM_JITTER_FRAMES];
+        if (slot.filled && slot.sequence == sequence && now - slot.arrival >= STREAM_JITTER_MS) {
+          newest = step;
+        }
+      }
+      if (newest > 0) {
+        for (int step = 1; step <= newest; step++) {
+          StreamFrame& slot = jitterBuffer[(uint16_t)(presentedSequence + step) % STREAM_JITTER_FRAMES];
+          if (step == newest) {
+            presentedFrame = slot.frame;
+          }
+          slot.filled = false;
+        }
+        presentedSequence += newest;
+        invalidateBuffer();
+        framesDropped += newest - 1;
+      }
+      portEXIT_CRITICAL(&lock);
+      return true;
+    }
+
+    uint32_t generation() {
+      portENTER_CRITICAL(&lock);
+      uint32_t current = getBufferGeneration();
+      portEXIT_CRITICAL(&lock);
+      return current;
+    }
+
+    bool getPixel(int x, int y) {
+      return presentedFrame.getPixel(x, y);
+    }
+
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      portENTER_CRITICAL(&lock);
+      target.blit(presentedFrame, sourceX, targetX, width);
+      portEXIT_CRITICAL(&lock);
+    }
+
+    bool handleInput(InputEventType inputEventType) {
+      return false;
+    }
+};
+
+/*
+UDP frame stream packet:
+- 'F' 'D'          magic
+- type             0 = full frame, 1 = XOR delta against sequence - 1,
+                   2 = FrameCodec record against sequence - 1
+- sequence         uint16, little endian
+- payload          PackedFrame::PACKED_BYTES bitstream or FrameCodec record
+The display switches to the stream on the first valid packet and back to the
+previous producer after STREAM_TIMEOUT_MS without one.
+*/
+class FrameStreamServer {
+  WiFiUDP udp;
+  StreamSurface streamSurface;
+  FlipDisplay& display;
+
+  BufferProducer* previousProducer = nullptr;
+  bool streaming = false;
+  uint32_t lastPacket = 0;
+
+  TaskHandle_t serverTask;
+
+  static const uint8_t HEADER_BYTES = 5;
 
   public:
 
-   BufferConsumer frameBuffer;
+    enum PacketType {
+        FULL_FRAME = 0
+      , DELTA_FRAME = 1
+      , CODED_FRAME = 2
+    };
 
-    FlipDisplay()
-    : frameBuffer()
-    , stateBuffer(DISPLAY_WIDTH, DISPLAY_HEIGHT)
+    FrameStreamServer(FlipDisplay& display)
+    : display(display)
     {
-      
+
     }
 
-    void begin() {
-      Serial2.begin(115200);
-      while(!Serial2);
+    void begin(uint16_t port = STREAM_PORT) {
+      udp.begin(port);
       xTaskCreatePinnedToCore (
-        renderer,
-        "Flip Display Renderer",
-        10000,
+        server,
+        "Frame stream server",
+        4000,
         this,
         1,
-        &renderTask,
-        1
+        &serverTask,
+        0
       );
     }
 
-    /*
-    On display update call:
-    - Check validity of required producers
-    - Redraw branches with invalid producers, ending in framebuffer consumer
-    - Draw framebuffer to display
-    */ 
-
-    void updateDisplay(bool fullRedraw = false) {  //TODO: replace enture display update functionality
-      frameBuffer.ensureBufferValidity();
-
-      for (int module = 0; module < MODULES; module ++) {
-        Serial2.write(0b10000000 | (module << 4));
-        for (int x = 0; x < MODULE_WIDTH; x ++) {
-          uint8_t colBuf = 0;
-          for (int y = 0; y < 7; y ++) {
-            colBuf |= frameBuffer.getPixel(x + module * 5, y) << y;
+    bool handlePacket(const uint8_t* packet, int length) {
+      if (length < HEADER_BYTES || packet[0] != 'F' || packet[1] != 'D') {
+        return false;
+      }
+      uint8_t type = packet[2];
+      uint16_t sequence = packet[3] | (packet[4] << 8);
+      const uint8_t* payload = packet + HEADER_BYTES;
+      int payloadLength = length - HEADER_BYTES;
+
+      PackedFrame frame;
+      switch (type) {
+        case FULL_FRAME:
+          if (payloadLength < PackedFrame::PACKED_BYTES) {
+            return false;
           }
-          Serial2.write(colBuf);
-        }
-        if (fullRedraw) {
-          Serial2.write(0b10000110 | (module << 4));
-        }
-        else {
-          Serial2.write(0b10000101 | (module << 4));
+          frame.unpackBits(payload);
+          return streamSurface.pushFrame(sequence, frame);
+        case DELTA_FRAME:
+          if (payloadLength < PackedFrame::PACKED_BYTES) {
+            return false;
+          }
+          frame.unpackBits(payload);
+          return streamSurface.pushDelta(sequence, frame);
+        case CODED_FRAME: {
+          uint16_t referenceSequence;
+          PackedFrame reference;
+          bool haveReference = streamSurface.getLastReceived(referenceSequence, reference);
+          if (FrameCodec::needsReference(payload, payloadLength) && (!haveReference || (uint16_t)(referenceSequence + 1) != sequence)) {
+            streamSurface.framesDropped ++;
+            return false;
+          }
+          if (FrameCodec::decode(payload, payloadLength, reference, frame) < 0) {
+            return false;
+          }
+          return streamSurface.pushFrame(sequence, frame);
         }
+        default:
+          return false;
       }
     }
 
-    static void renderer(void* pvParameters) {
-      FlipDisplay* flipDisplay = (FlipDisplay*)pvParameters;
-      for (;;){
-        flipDisplay->updateDisplay(fullRedraw);
-        fullRedraw = false;
+  private:
 
-        #ifdef OLED_DISPLAY
-          for (int x = 0; x < 40; x ++) {
-            for (int y = 0; y < 7; y ++) {
-              oled.drawPixel(x*3, y*3+1, flipDisplay->frameBuffer.getPixel(x, y));
-              oled.drawPixel(x*3+1, y*3, flipDisplay->frameBuffer.getPixel(x, y));
-              oled.drawPixel(x*3+1, y*3+1, flipDisplay->frameBuffer.getPixel(x, y));
-              oled.drawPixel(x*3+1, y*3+2, flipDisplay->frameBuffer.getPixel(x, y));
-              oled.drawPixel(x*3+2, y*3+1, flipDisplay->frameBuffer.getPixel(x, y));
+    void startStreaming() {
+      streamSurface.reset();
+      uiQueue.post([this]() {
+        previousProducer = display.frameBuffer.boundProducer();
+        display.frameBuffer.bindToProducer(&streamSurface);
+      });
+      streaming = true;
+    }
+
+    void stopStreaming() {
+      uiQueue.post([this]() {
+        // Leave the display alone if something else (an OTA update) took it over while we streamed
+        if (display.frameBuffer.boundProducer() == &streamSurface) {
+          display.frameBuffer.bindToProducer(previousProducer);
+        }
+      });
+      streaming = false;
+    }
+
+    static void server(void* pvParameters) {
+      FrameStreamServer* frameServer = (FrameStreamServer*)pvParameters;
+      uint8_t packet[64];
+
+      for (;;) {
+        int length = frameServer->udp.parsePacket();
+        if (length > 0) {
+          length = frameServer->udp.read(packet, sizeof(packet));
+          if (length >= HEADER_BYTES && packet[0] == 'F' && packet[1] == 'D') {
+            if (!frameServer->streaming) {
+              frameServer->startStreaming();
             }
+            frameServer->lastPacket = millis();
+            frameServer->handlePacket(packet, length);
           }
-        #endif
-
+          continue;
+        }
 
-        vTaskDelay(16/portTICK_PERIOD_MS ); // 60 FPS: 16ms/frame
+        if (frameServer->streaming && millis() - frameServer->lastPacket > STREAM_TIMEOUT_MS) {
+          frameServer->stopStreaming();
+        }
+        vTaskDelay(2/portTICK_PERIOD_MS);
       }
     }
-
-    void handleInput(InputEventType InputEventType) {
-      frameBuffer.handleInput(InputEventType);
-    }
 };
 
-
 class Application;
 
 class BaseActivity: public BufferProducer {
@@ -805,7 +3197,7 @@ public:
     visibility = false;
     if (deletionMarker) {
       onDestroy();
-      delete this;
+      frameReclaimer.retire(this);
       return;
     }
   }
@@ -832,12 +3224,15 @@ private:
 
   Application* launcher;
 
+  std::vector<BaseActivity*> closedActivities; // Waiting to be scrolled off screen before deletion
+  SemaphoreHandle_t closedActivitiesLock = xSemaphoreCreateMutex();
+
 public:
 
   ActivityManager()
   : SurfaceScrollerImproved(false)
   {
-
+    cacheOutput = true; // A settled screen renders as one copy
   }
 
   void startActivity(BaseActivity* activity) {
@@ -893,6 +3288,10 @@ public:
     activity->markForDeletion();
     activityStack.pop();
 
+    xSemaphoreTake(closedActivitiesLock, portMAX_DELAY);
+    closedActivities.push_back(activity);
+    xSemaphoreGive(closedActivitiesLock);
+
     if (activityStack.empty()) {
       goToStack(launcher);
       appActivityStacks.erase(parentApplication);
@@ -917,10 +3316,34 @@ public:
     return false;
   }
 
+  void instructionComplete() {
+    std::vector<BaseActivity*> offscreenActivities;
+
+    xSemaphoreTake(closedActivitiesLock, portMAX_DELAY);
+    for (auto activity = closedActivities.begin(); activity != closedActivities.end(); ) {
+      if (isReferenced(*activity)) {
+        activity ++;
+      }
+      else {
+        offscreenActivities.push_back(*activity);
+        activity = closedActivities.erase(activity);
+      }
+    }
+    xSemaphoreGive(closedActivitiesLock);
+
+    for (BaseActivity* activity : offscreenActivities) {
+      postLifecycle([activity]() {
+        activity->invisible(); // Hands the activity to frameReclaimer
+      });
+    }
+  }
+
 private:
   void setupCompletionCallback(BaseActivity* activity) {
     activity->setCompletionCallback([this, activity]() {
-      closeActivity(activity);
+      uiQueue.post([this, activity]() { // Completion can fire on any task
+        closeActivity(activity);
+      });
     });
   }
 };
@@ -951,6 +3374,11 @@ class CountdownTimer: public Application {
     CountdownTimer* countdownApp = (CountdownTimer*)pvParameters;
     while (countdownApp->timer >= 0) {
       countdownApp->timer -= 1;
+      if (countdownApp->timer == 0) {
+        uiQueue.post([countdownApp]() {
+          activityManager.startActivity(new AlarmActivity(countdownApp));
+        });
+      }
       vTaskDelay(1000/portTICK_PERIOD_MS);
     }
     countdownApp->timer = -1;
@@ -988,7 +3416,7 @@ class CountdownTimer: public Application {
 
   class CountdownActivity: public BaseActivity {
     TextSurface countdown;
-    int32_t timer;
+    int32_t timer = -1; // Last value shown
 
     CountdownTimer* parentTimer;
 
@@ -1018,19 +3446,10 @@ class CountdownTimer: public Application {
         countdown.setText(hours + ":" + minutes + ":" + seconds);
       }
 
-      bool startedthing = false;
-
-      bool ensureBufferValidity(bool includeInactive) {
-        timer = parentTimer->timer;
-        if (timer == 0) {
-          updateCountdown();
-          //activityComplete();
-          if (!startedthing) {
-            activityManager.startActivity(new CountdownTimer::AlarmActivity(parentTimer));
-          }
-          startedthing = true;
-        }
-        else if (timer > 0) {
+      bool ensureBufferValidity(bool includeInactive) { // The countdown task starts the alarm
+        int32_t remaining = parentTimer->timer;
+        if (remaining >= 0 && remaining != timer) {
+          timer = remaining;
           updateCountdown();
         }
         return true;
@@ -1043,6 +3462,14 @@ class CountdownTimer: public Application {
       bool getPixel(int x, int y) {
         return countdown.getPixel(x, y);
       }
+
+      uint32_t generation() {
+        return countdown.generation();
+      }
+
+      void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+        countdown.render(target, targetX, sourceX, width);
+      }
   };
 
   class timerSetupActivity: public BaseActivity {
@@ -1061,6 +3488,8 @@ class CountdownTimer: public Application {
     NumberInput secondsMinorScroller;
     NumberInput secondsMajorScroller;
 
+    CompositeSurface layout;
+
   public:
     timerSetupActivity(CountdownTimer* parentApplicationPointer) 
     : BaseActivity(parentApplicationPointer)
@@ -1073,7 +3502,13 @@ class CountdownTimer: public Application {
     , secondsMinorScroller()
     , background("--:--:--")
     {
-      
+      layout.addLayer(&background, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, 0);
+      layout.addLayer(&hoursMajorScroller, 0, 0, 4, DISPLAY_HEIGHT, 1);
+      layout.addLayer(&hoursMinorScroller, 4, 0, 4, DISPLAY_HEIGHT, 1);
+      layout.addLayer(&minutesMajorScroller, 10, 0, 4, DISPLAY_HEIGHT, 1);
+      layout.addLayer(&minutesMinorScroller, 14, 0, 4, DISPLAY_HEIGHT, 1);
+      layout.addLayer(&secondsMajorScroller, 20, 0, 4, DISPLAY_HEIGHT, 1);
+      layout.addLayer(&secondsMinorScroller, 24, 0, 4, DISPLAY_HEIGHT, 1);
     }
 
     bool timerStarted = false;
@@ -1088,7 +3523,7 @@ class CountdownTimer: public Application {
     }
 
     bool ensureBufferValidity(bool includeInactive) {
-      return true;
+      return layout.ensureBufferValidity(includeInactive);
     }
 
     bool handleInput(InputEventType inputEventType) {
@@ -1136,25 +3571,15 @@ class CountdownTimer: public Application {
     }
 
     bool getPixel(int x, int y) {
-      if (x >= 0 && x <= 3) {
-        return hoursMajorScroller.getPixel(x, y);
-      }
-      if (x >=4 && x <= 7) {
-        return hoursMinorScroller.getPixel(x - 4, y);
-      }
-      if (x >= 10 && x <= 13) {
-        return minutesMajorScroller.getPixel(x-10, y);
-      }
-      if (x >=14 && x <= 17) {
-        return minutesMinorScroller.getPixel(x - 14, y);
-      }
-      if (x >= 20 && x <= 23) {
-        return secondsMajorScroller.getPixel(x - 20, y);
-      }
-      if (x >=24 && x <= 27) {
-        return secondsMinorScroller.getPixel(x - 24, y);
-      }
-      return background.getPixel(x, y);
+      return layout.getPixel(x, y);
+    }
+
+    uint32_t generation() {
+      return layout.generation();
+    }
+
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      layout.renderCached(target, targetX, sourceX, width);
     }
 
   };
@@ -1172,7 +3597,7 @@ class CountdownTimer: public Application {
         xTaskCreatePinnedToCore (
           countdownTask,
           "Countdown timer task",
-          1000,
+          3000, // Posting the alarm builds a std::function and grows the UI queue
           this,
           1,
           &countdownTaskHandle,
@@ -1191,6 +3616,68 @@ class CountdownTimer: public Application {
 
 CountdownTimer countdownTimer;
 
+class Showreel: public Application {
+public:
+
+  class ReelActivity: public BaseActivity {
+  public:
+    ReelActivity(Showreel* parentApplicationPointer)
+    : BaseActivity(parentApplicationPointer)
+    {
+
+    }
+
+    void enterVisibility() {
+      flashAnimation.restart();
+    }
+
+    // Once settled on screen the drivers play the reel from their own queues, scrolls and overlays need composed frames
+    void enterFocus() {
+      focus = true; // The scroller calls the hooks directly, not focussed()
+      display.playAhead(&flashAnimation);
+    }
+
+    void exitFocus() {
+      focus = false;
+      display.playAhead(nullptr);
+    }
+
+    void exitVisibility() {
+      focus = false;
+      display.playAhead(nullptr);
+    }
+
+    bool ensureBufferValidity(bool includeInactive) {
+      return flashAnimation.ensureBufferValidity(includeInactive);
+    }
+
+    bool handleInput(InputEventType inputEventType) {
+      if (inputEventType == CENTER_SINGLE) {
+        flashAnimation.restart();
+        if (focus) {
+          display.playAhead(&flashAnimation); // Drop the frames queued from before the restart
+        }
+        return true;
+      }
+      return false;
+    }
+
+    bool getPixel(int x, int y) {
+      return flashAnimation.getPixel(x, y);
+    }
+
+    uint32_t generation() {
+      return flashAnimation.generation();
+    }
+
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      flashAnimation.render(target, targetX, sourceX, width);
+    }
+  };
+};
+
+Showreel showreel;
+
 class Launcher: public Application {
 public:
 
@@ -1200,11 +3687,12 @@ public:
 
   class HomeScreen: public BaseActivity {
     Menu menu;
-    BufferProducer *menuItems[5] = {
+    BufferProducer *menuItems[6] = {
       new TextSurface("Timer"),
       new TextSurface("Stopwatch"),
       new TextSurface("Snake"),
       new TextSurface("Tetris"),
+      new TextSurface("Showreel"),
       new TextSurface("Settings")
     };
 
@@ -1213,7 +3701,7 @@ public:
     HomeScreen(Launcher* parentApplication)
     : BaseActivity(parentApplication)
     {
-      for (int i = 0; i < 5; i++) 
+      for (int i = 0; i < 6; i++) 
         menu.menuItems.push_back(menuItems[i]);
       menu.setFrame(menuItems[0]);
     }
@@ -1222,6 +3710,14 @@ public:
       return menu.getPixel(x, y);
     }
 
+    uint32_t generation() {
+      return menu.generation();
+    }
+
+    void render(PackedFrame& target, int targetX = 0, int sourceX = 0, int width = DISPLAY_WIDTH) {
+      menu.render(target, targetX, sourceX, width);
+    }
+
     bool ensureBufferValidity(bool inclueInactive = false) {
       return menu.ensureBufferValidity(inclueInactive);
     }
@@ -1230,6 +3726,10 @@ public:
       if (menu.handleInput(inputEventType)) {
         return true;
       }
+      if (menu.menuPosition == 4) {
+        activityManager.startActivity(new Showreel::ReelActivity(&showreel));
+        return true;
+      }
       activityManager.startActivity(new CountdownTimer::timerSetupActivity(&countdownTimer));
       return true;
     }
@@ -1239,48 +3739,279 @@ public:
 
 Launcher launcher;
 
-FlipDisplay display;
+FrameStreamServer streamServer(display);
 
-StaticBuffer updateScreen("Updating");
+// Progress text that only redraws when the shown percentage changes, no faster than the panel can flip it
+class ProgressBuffer: public StaticBuffer {
+  const char* label;
+  int shownPercent = -1;
+  uint32_t lastRender = 0;
 
-void setup() {
-  display.begin();
+  public:
+    ProgressBuffer(const char* label, const char* initialText)
+    : StaticBuffer(initialText)
+    , label(label)
+    {
 
-  
-  #ifdef OLED_DISPLAY
-    oled.begin(SSD1306_SWITCHCAPVCC, 0x3C);
-    oled.clearDisplay();
-    oled.display();
-  #endif
+    }
 
-  Wire.begin();
+    void setProgress(unsigned int progress, unsigned int total, bool force = false) {
+      int percent = total ? (uint64_t)progress * 100 / total : 0;
+      uint32_t now = millis();
+      if (percent == shownPercent || (!force && now - lastRender < OTA_PROGRESS_INTERVAL_MS)) {
+        return;
+      }
+      char text[16];
+      snprintf(text, sizeof(text), "%s: %d%%", label, percent);
+      setText(text);
+      shownPercent = percent;
+      lastRender = now;
+    }
+};
+
+ProgressBuffer updateScreen("OTA", "Updating");
+
+// Brings up WiFi in the background and starts the network services once connected.
+// Failed attempts back off exponentially, the display keeps running without a network.
+class ConnectionManager {
+  TaskHandle_t connectionTask;
+  TaskHandle_t otaTask;
+  bool servicesStarted = false;
+
+  void startServices() {
+    ArduinoOTA.begin();
+    xTaskCreatePinnedToCore (
+      otaService,
+      "OTA service",
+      8000,
+      this,
+      1,
+      &otaTask,
+      0
+    );
+    streamServer.begin();
+    servicesStarted = true;
+  }
+
+  // A transfer runs inside handle(), so it proceeds at network speed independent of loop() and the renderer
+  static void otaService(void* pvParameters) {
+    for (;;) {
+      ArduinoOTA.handle();
+      vTaskDelay(OTA_POLL_MS / portTICK_PERIOD_MS);
+    }
+  }
+
+  static void manager(void* pvParameters) {
+    ConnectionManager* connectionManager = (ConnectionManager*)pvParameters;
+    uint32_t backoff = WIFI_BACKOFF_MIN_MS;
+
+    WiFi.setHostname(WIFI_HOSTNAME);
+    WiFi.mode(WIFI_STA);
+
+    for (;;) {
+      if (WiFi.status() != WL_CONNECTED) {
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+        uint32_t attemptStart = millis();
+        while (WiFi.status() != WL_CONNECTED && millis() - attemptStart < WIFI_CONNECT_TIMEOUT_MS) {
+          vTaskDelay(100 / portTICK_PERIOD_MS);
+        }
+
+        if (WiFi.status() != WL_CONNECTED) {
+          Serial.printf("WiFi connection failed, retrying in %ums\n", backoff);
+          WiFi.disconnect();
+          vTaskDelay(backoff / portTICK_PERIOD_MS);
+          backoff = min(backoff * 2, (uint32_t)WIFI_BACKOFF_MAX_MS);
+          continue;
+        }
+
+        Serial.printf("WiFi connected: %s\n", WiFi.localIP().toString().c_str());
+        backoff = WIFI_BACKOFF_MIN_MS;
+        if (!connectionManager->servicesStarted) {
+          connectionManager->startServices();
+        }
+      }
+      vTaskDelay(1000 / portTICK_PERIOD_MS);
+    }
+  }
+
+  public:
+
+    void begin() {
+      xTaskCreatePinnedToCore (
+        manager,
+        "Connection manager",
+        4000,
+        this,
+        1,
+        &connectionTask,
+        0
+      );
+    }
+
+    bool isConnected() {
+      return WiFi.status() == WL_CONNECTED;
+    }
+};
+
+ConnectionManager connectionManager;
+
+#ifdef RENDER_BENCHMARK
+
+#define BENCHMARK_SCENE_MS 4000
+
+// Renders a scene at the normal frame rate for BENCHMARK_SCENE_MS, calling drive()
+// every frame to inject input, and prints one JSON object of compose cost and UART bytes
+void benchmarkScene(const char* name, BufferProducer* producer, std::function<void(int)> drive, bool first) {
+  static uint32_t composeNanoseconds[512];
+  BufferConsumer consumer;
+  consumer.bindToProducer(producer);
+
+  int frames = 0;
+  uint64_t totalNanoseconds = 0;
+  uint64_t totalBytes = 0;
+  uint32_t sceneStart = millis();
+  uint32_t cyclesPerMicrosecond = getCpuFrequencyMhz();
+
+  while (millis() - sceneStart < BENCHMARK_SCENE_MS) {
+    drive(frames);
+
+    PackedFrame frame;
+    uint32_t frameEpoch = frameReclaimer.frameBegin(); // As the renderer, so closed activities are freed
+    uint32_t start = ESP.getCycleCount();
+    consumer.ensureBufferValidity();
+    consumer.render(frame);
+    uint32_t nanoseconds = (uint64_t)(ESP.getCycleCount() - start) * 1000 / cyclesPerMicrosecond;
 
-  usb.begin();
+    totalBytes += display.transmitFrame(frame);
+    frameReclaimer.frameEnd(frameEpoch);
+    totalNanoseconds += nanoseconds;
+    composeNanoseconds[frames % 512] = nanoseconds;
+    frames ++;
 
+    vTaskDelay(FRAME_PERIOD_MS/portTICK_PERIOD_MS);
+  }
+
+  // Anything retired during the last frame goes before the next scene is measured
+  frameReclaimer.frameEnd(frameReclaimer.frameBegin());
+
+  int samples = min(frames, 512);
+  std::sort(composeNanoseconds, composeNanoseconds + samples);
+  uint32_t meanNanoseconds = frames ? totalNanoseconds / frames : 0;
+
+  Serial.printf("%s{\"name\":\"%s\",\"frames\":%d,\"ns_per_frame\":%u,\"ns_p50\":%u,\"ns_p99\":%u,\"ns_max\":%u,\"compose_fps\":%u,\"bytes_per_frame\":%.2f}",
+    first ? "" : ",", name, frames, meanNanoseconds,
+    samples ? composeNanoseconds[samples / 2] : 0,
+    samples ? composeNanoseconds[(samples * 99) / 100] : 0,
+    samples ? composeNanoseconds[samples - 1] : 0,
+    meanNanoseconds ? 1000000000UL / meanNanoseconds : 0,
+    frames ? (double)totalBytes / frames : 0.0);
+}
+
+void runBenchmarks() {
+  Serial.printf("{\"build\":\"%s %s\",\"frame_period_ms\":%d,\"scenes\":[", __DATE__, __TIME__, FRAME_PERIOD_MS);
+
+  Launcher::HomeScreen* homeScreen = new Launcher::HomeScreen(&launcher);
+  benchmarkScene("home_idle", homeScreen, [](int frame) {}, true);
+
+  benchmarkScene("menu_scroll", homeScreen, [homeScreen](int frame) {
+    if (frame % 8 == 0) {
+      homeScreen->handleInput((frame / 64) % 2 ? UP_SINGLE : DOWN_SINGLE);
+    }
+  }, false);
+
+  CountdownTimer::timerSetupActivity* timerSetup = new CountdownTimer::timerSetupActivity(&countdownTimer);
+  benchmarkScene("timer_setup_inputs", timerSetup, [timerSetup](int frame) {
+    // Step every one of the six NumberInputs, then walk the selection back
+    int phase = frame % 24;
+    if (phase < 12) {
+      timerSetup->handleInput(phase % 2 ? RIGHT_SINGLE : UP_SINGLE);
+    }
+    else if (phase < 18) {
+      timerSetup->handleInput(LEFT_SINGLE);
+    }
+  }, false);
+  uiQueue.post([timerSetup]() {
+    delete timerSetup; // Its six scroller tasks would otherwise stay on the heap for the remaining scenes, queued behind their lifecycle callbacks
+  });
+
+  activityManager.setLauncher(&launcher);
+  activityManager.startActivity(homeScreen);
+  benchmarkScene("activity_transitions", &activityManager, [](int frame) {
+    if (frame % 60 == 0) {
+      activityManager.startActivity(new CountdownTimer::timerSetupActivity(&countdownTimer));
+    }
+    else if (frame % 60 == 30) {
+      activityManager.handleInput(LEFT_SINGLE);
+    }
+  }, false);
+
+  countdownTimer.TimerSet(36000);
+  CountdownTimer::CountdownActivity* countdown = new CountdownTimer::CountdownActivity(&countdownTimer);
+  benchmarkScene("countdown_running", countdown, [](int frame) {}, false);
+  uiQueue.post([countdown]() {
+    delete countdown;
+  });
+
+  Serial.println("]}");
+}
+
+#endif
+
+void setup() {
+  #ifdef RENDER_BENCHMARK
+    Serial.begin(115200);
+    display.begin(false);
+    uiQueue.begin(); // Scrollers post their lifecycle callbacks here
+    runBenchmarks();
+    return;
+  #endif
 
   Serial.begin(115200);
 
+  Wire.begin();
+  powerScheduler.begin(usb);
+  Serial.printf("Supply %dmV %dmA, %d modules flipping at once\n", powerScheduler.supplyMillivolts, powerScheduler.supplyMilliamps, powerScheduler.getMaxFlipping());
+
+  flashAnimation.begin();
+
+  // Content and input first, the network comes up in the background
+  activityManager.setLauncher(&launcher);
+  activityManager.startActivity(new Launcher::HomeScreen(&launcher));
+  display.frameBuffer.bindToProducer(&activityManager);
+  uiQueue.begin();
 
-  WiFi.setHostname("Flipdot Display");
-  ArduinoOTA.setHostname("Flipdot Display");
-  WiFi.mode(WIFI_STA);  
-  WiFi.begin("TALKTALK21516E", "YJ7P49A4");
+  pinMode(INPUT_CENTER, INPUT);
+  pinMode(INPUT_LEFT, INPUT);
+  pinMode(INPUT_RIGHT, INPUT);
+  pinMode(INPUT_UP, INPUT);
+  pinMode(INPUT_DOWN, INPUT);
 
-  while (WiFi.waitForConnectResult() != WL_CONNECTED) {
-    Serial.println("Connection Failed! Rebooting...");
-    delay(5000);
-    ESP.restart();
+  PackedFrame panelImage;
+  if (panelStore.begin(panelImage)) {
+    display.seedState(panelImage);
+    fullRedraw = false;
   }
+  display.begin();
+
+  #ifdef OLED_DISPLAY
+    oled.begin(SSD1306_SWITCHCAPVCC, 0x3C);
+    oled.clearDisplay();
+    oled.display();
+  #endif
 
+  ArduinoOTA.setHostname(WIFI_HOSTNAME);
   ArduinoOTA
     .onStart([]() {
-      display.frameBuffer.bindToProducer(updateScreen.getProducer());
+      uiQueue.post([]() {
+        display.frameBuffer.bindToProducer(updateScreen.getProducer());
+      });
     })
     .onEnd([]() {
+      updateScreen.setProgress(1, 1, true);
       Serial.println("\nEnd");
     })
     .onProgress([](unsigned int progress, unsigned int total) {
-      updateScreen.setText("OTA: " + (String)(progress / (total / 100)) + "%");
+      updateScreen.setProgress(progress, total);
     })
     .onError([](ota_error_t error) {
       Serial.printf("Error[%u]: ", error);
@@ -1291,18 +4022,7 @@ void setup() {
       else if (error == OTA_END_ERROR) Serial.println("End Failed");
     });
 
-  ArduinoOTA.begin();
-  fullRedraw = true;
-
-  activityManager.setLauncher(&launcher);
-  activityManager.startActivity(new Launcher::HomeScreen(&launcher));
-  display.frameBuffer.bindToProducer(&activityManager);
-
-  pinMode(INPUT_CENTER, INPUT);
-  pinMode(INPUT_LEFT, INPUT);
-  pinMode(INPUT_RIGHT, INPUT);
-  pinMode(INPUT_UP, INPUT);
-  pinMode(INPUT_DOWN, INPUT);
+  connectionManager.begin();
 
   #ifdef OLED_DISPLAY
     oled.display();
@@ -1312,20 +4032,57 @@ void setup() {
 }
 
 void loop() {
+  #ifdef RENDER_BENCHMARK
+    delay(1000);
+    return;
+  #endif
+
+  while (Serial.available()) {
+    char command = Serial.read();
+    if (command == 'u') {
+      driverUpdater.run(display, Serial);
+    }
+    else if (command == 'c') {
+      String line = Serial.readStringUntil('\n');
+      driverCalibrator.handleCommand(line.c_str(), display, Serial);
+    }
+    else if (command == 'd') { // Pulse trace dump on a PULSE_TRACE driver, read from that driver's own TX pin
+      long module = Serial.readStringUntil('\n').toInt();
+      if (module >= 0 && module < MODULES) {
+        display.acquireBus();
+        Serial2.write(0b10000111 | (module << 4));
+        Serial2.flush();
+        display.releaseBus();
+      }
+    }
+    else if (command == 'o') { // Flip order, register 8 value as for DRIVER_FLIP_ORDER
+      long order = Serial.readStringUntil('\n').toInt();
+      if (order >= 0 && order <= 0x0F) {
+        display.setFlipOrder(order);
+        Serial.printf("Flip order %ld\n", order);
+      }
+    }
+    else {
+      profiler.handleCommand(command, Serial);
+    }
+  }
+
+  panelStore.update(display.getState());
+
   if (!digitalRead(INPUT_UP)) {
-    display.handleInput(UP_SINGLE);
+    uiQueue.post([]() { display.handleInput(UP_SINGLE); });
   }
   if (!digitalRead(INPUT_DOWN)) {
-    display.handleInput(DOWN_SINGLE);
+    uiQueue.post([]() { display.handleInput(DOWN_SINGLE); });
   }
   if (!digitalRead(INPUT_LEFT)) {
-    display.handleInput(LEFT_SINGLE);
+    uiQueue.post([]() { display.handleInput(LEFT_SINGLE); });
   }
   if (!digitalRead(INPUT_RIGHT)) {
-    display.handleInput(RIGHT_SINGLE);
+    uiQueue.post([]() { display.handleInput(RIGHT_SINGLE); });
   }
   if (!digitalRead(INPUT_CENTER)) {
-    display.handleInput(CENTER_SINGLE);
+    uiQueue.post([]() { display.handleInput(CENTER_SINGLE); });
   }
 
   for (int i =0; i < 10; i ++) {
@@ -1333,7 +4090,6 @@ void loop() {
       oled.display();
     #endif
 
-    ArduinoOTA.handle();
     delay(12);
   }
 }
\ No newline at end of file
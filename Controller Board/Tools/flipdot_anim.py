@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Build a flash partition image for FlashAnimation on the controller.
+
+Input frames are drawn as 7 rows of '#' (on) and '.' (off) with a blank line
+between frames. A line "@150" sets the duration in milliseconds of the frames
+that follow it. Recorded streams from flipdot_codec.py (.fds) are accepted too.
+
+Image layout (little endian):
+  "FDA1", uint32 record bytes, uint8 flags (bit 0 = loop), 3 reserved bytes,
+  then records of uint16 duration_ms, uint16 length, FrameCodec record.
+
+Usage:
+  flipdot_anim.py reel.txt anim.bin --loop
+  esptool.py --chip esp32 write_flash 0x290000 anim.bin   # "anim" offset in partitions.csv
+"""
+
+import argparse
+import struct
+
+from flipdot_codec import STREAM_MAGIC, Encoder
+from flipdot_stream import HEIGHT, WIDTH
+
+IMAGE_MAGIC = b"FDA1"
+PARTITION_SIZE = 0x150000
+FLAG_LOOP = 0x01
+
+
+def parse_timed_frames(path, default_duration):
+    """Yield (duration_ms, columns) pairs from a frame text file."""
+    duration = default_duration
+    rows = []
+    with open(path) as source:
+        for line in source.read().splitlines() + [""]:
+            stripped = line.strip()
+            if stripped.startswith("@"):
+                duration = int(stripped[1:])
+                continue
+            if stripped:
+                rows.append(line)
+                continue
+            if rows:
+                columns = [0] * WIDTH
+                for y, row in enumerate(rows[:HEIGHT]):
+                    for x, char in enumerate(row[:WIDTH]):
+                        if char == "#":
+                            columns[x] |= 1 << y
+                yield duration, columns
+                rows = []
+
+
+def records_from_frames(path, default_duration, keyframe_interval):
+    encoder = Encoder(keyframe_interval)
+    records = bytearray()
+    count = 0
+    for duration, columns in parse_timed_frames(path, default_duration):
+        record = encoder.encode(columns)
+        records += struct.pack("<HH", duration, len(record)) + record
+        count += 1
+    return bytes(records), count
+
+
+def records_from_stream(path):
+    with open(path, "rb") as source:
+        data = source.read()
+    if not data.startswith(STREAM_MAGIC):
+        raise SystemExit("%s is not a recorded stream" % path)
+    records = data[len(STREAM_MAGIC):]
+
+    count = 0
+    position = 0
+    while position + 4 <= len(records):
+        _, length = struct.unpack_from("<HH", records, position)
+        position += 4 + length
+        count += 1
+    return records, count
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="frame text file or .fds recorded stream")
+    parser.add_argument("output", help="partition image to write")
+    parser.add_argument("--duration", type=int, default=100, help="default milliseconds per frame")
+    parser.add_argument("--loop", action="store_true")
+    parser.add_argument("--keyframe-interval", type=int, default=0, help="0 = only the first frame")
+    args = parser.parse_args()
+
+    if args.input.endswith(".fds"):
+        records, count = records_from_stream(args.input)
+    else:
+        records, count = records_from_frames(args.input, args.duration, args.keyframe_interval)
+
+    header = IMAGE_MAGIC + struct.pack("<IB3x", len(records), FLAG_LOOP if args.loop else 0)
+    image = header + records
+    if len(image) > PARTITION_SIZE:
+        raise SystemExit("image is %d bytes, partition holds %d" % (len(image), PARTITION_SIZE))
+
+    with open(args.output, "wb") as out:
+        out.write(image)
+    print("%d frames, %d bytes (%.1f%% of partition)" % (count, len(image), 100.0 * len(image) / PARTITION_SIZE))
+
+
+if __name__ == "__main__":
+    main()
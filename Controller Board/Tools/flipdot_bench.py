@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+Collect and compare rendering benchmark results from the controller.
+
+Flash the benchmark environment (pio run -e benchmark -t upload), then:
+  flipdot_bench.py capture /dev/ttyUSB0 results.json     # needs pyserial
+  flipdot_bench.py compare baseline.json results.json    # non-zero exit on regression
+"""
+
+import argparse
+import json
+import sys
+import time
+
+METRICS = ("ns_per_frame", "ns_p99", "bytes_per_frame")
+
+
+def capture(port, output, timeout):
+    import serial
+
+    with serial.Serial(port, 115200, timeout=1) as connection:
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            line = connection.readline().decode(errors="replace").strip()
+            if line.startswith('{"build"'):
+                results = json.loads(line)
+                with open(output, "w") as out:
+                    json.dump(results, out, indent=2)
+                print("captured %d scenes from build %s" % (len(results["scenes"]), results["build"]))
+                return 0
+    print("no benchmark output within %d s" % timeout, file=sys.stderr)
+    return 1
+
+
+def compare(baseline_path, results_path, threshold):
+    with open(baseline_path) as source:
+        baseline = {scene["name"]: scene for scene in json.load(source)["scenes"]}
+    with open(results_path) as source:
+        results = json.load(source)["scenes"]
+
+    regressions = 0
+    for scene in results:
+        before = baseline.get(scene["name"])
+        if not before:
+            print("%-22s new scene" % scene["name"])
+            continue
+        for metric in METRICS:
+            old, new = before[metric], scene[metric]
+            change = (new - old) / old * 100.0 if old else 0.0
+            flag = ""
+            if change > threshold:
+                flag = "  REGRESSION"
+                regressions += 1
+            print("%-22s %-16s %12.2f -> %12.2f  %+6.1f%%%s" % (scene["name"], metric, old, new, change, flag))
+    return 1 if regressions else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    capture_parser = commands.add_parser("capture")
+    capture_parser.add_argument("port")
+    capture_parser.add_argument("output")
+    capture_parser.add_argument("--timeout", type=int, default=60)
+
+    compare_parser = commands.add_parser("compare")
+    compare_parser.add_argument("baseline")
+    compare_parser.add_argument("results")
+    compare_parser.add_argument("--threshold", type=float, default=10.0, help="allowed increase in percent")
+
+    args = parser.parse_args()
+    if args.command == "capture":
+        return capture(args.port, args.output, args.timeout)
+    return compare(args.baseline, args.results, args.threshold)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
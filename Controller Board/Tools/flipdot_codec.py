@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""
+Encoder for the flipdot frame stream format (FrameCodec in the controller firmware).
+
+Each frame record is one of:
+  0x00 KEY_FRAME    35 byte packed bitstream
+  0x01 DELTA_FRAME  column ops against the previous frame
+  0x02 SHIFT_FRAME  int8 dx, int8 dy, column ops against the previous frame
+                    shifted left by dx and up by dy
+Column ops: 0b1NNNNNNN skips N + 1 unchanged columns, 0b0VVVVVVV XORs V into the
+current column. Trailing unchanged columns are omitted.
+
+Recorded streams (.fds) are "FDS1" followed by records of
+  uint16 duration_ms, uint16 length, frame record
+all little endian.
+
+Usage:
+  flipdot_codec.py frames.txt out.fds [--duration MS]   # encode a frame file, print statistics
+"""
+
+import argparse
+import struct
+
+from flipdot_stream import HEIGHT, PACKED_BYTES, WIDTH, pack_columns, parse_frames
+
+KEY_FRAME = 0
+DELTA_FRAME = 1
+SHIFT_FRAME = 2
+
+COLUMN_MASK = (1 << HEIGHT) - 1
+
+SHIFTS_X = range(-4, 5)
+SHIFTS_Y = range(-2, 3)
+
+STREAM_MAGIC = b"FDS1"
+
+
+def unpack_columns(packed):
+    value = int.from_bytes(packed, "little")
+    return [(value >> (x * HEIGHT)) & COLUMN_MASK for x in range(WIDTH)]
+
+
+def shift(columns, dx, dy):
+    """Shift left by dx columns and up by dy rows, matching PackedFrame::shiftLeft/shiftUp."""
+    if dx >= 0:
+        shifted = columns[dx:] + [0] * min(dx, WIDTH)
+    else:
+        shifted = [0] * min(-dx, WIDTH) + columns[:dx]
+    shifted = shifted[:WIDTH]
+    if dy >= 0:
+        return [(column >> dy) & COLUMN_MASK for column in shifted]
+    return [(column << -dy) & COLUMN_MASK for column in shifted]
+
+
+def column_ops(columns, reference):
+    ops = bytearray()
+    skip = 0
+    for column, base in zip(columns, reference):
+        difference = column ^ base
+        if difference == 0:
+            skip += 1
+            continue
+        while skip:
+            run = min(skip, 128)
+            ops.append(0x80 | (run - 1))
+            skip -= run
+        ops.append(difference)
+    return bytes(ops)
+
+
+def encode(columns, reference=None):
+    """Return the smallest record describing columns, given the previous frame."""
+    best = bytes([KEY_FRAME]) + pack_columns(columns)
+    if reference is None:
+        return best
+
+    candidate = bytes([DELTA_FRAME]) + column_ops(columns, reference)
+    if len(candidate) < len(best):
+        best = candidate
+
+    for dx in SHIFTS_X:
+        for dy in SHIFTS_Y:
+            if dx == 0 and dy == 0:
+                continue
+            ops = column_ops(columns, shift(reference, dx, dy))
+            if 3 + len(ops) < len(best):
+                best = bytes([SHIFT_FRAME]) + struct.pack("<bb", dx, dy) + ops
+    return best
+
+
+def decode(record, reference):
+    """Decode one record, returning (columns, bytes consumed)."""
+    frame_type = record[0]
+    if frame_type == KEY_FRAME:
+        return unpack_columns(record[1:1 + PACKED_BYTES]), 1 + PACKED_BYTES
+
+    position = 1
+    columns = list(reference)
+    if frame_type == SHIFT_FRAME:
+        dx, dy = struct.unpack("<bb", record[1:3])
+        columns = shift(columns, dx, dy)
+        position = 3
+    elif frame_type != DELTA_FRAME:
+        raise ValueError("unknown frame type %d" % frame_type)
+
+    column = 0
+    while column < WIDTH and position < len(record):
+        op = record[position]
+        position += 1
+        if op & 0x80:
+            column += (op & 0x7F) + 1
+        else:
+            columns[column] ^= op
+            column += 1
+    return columns, position
+
+
+class Encoder:
+    """Stateful encoder that inserts a keyframe every keyframe_interval frames."""
+
+    def __init__(self, keyframe_interval=50):
+        self.keyframe_interval = keyframe_interval
+        self.previous = None
+        self.count = 0
+
+    def encode(self, columns):
+        reference = self.previous
+        if self.keyframe_interval and self.count % self.keyframe_interval == 0:
+            reference = None
+        record = encode(columns, reference)
+        self.previous = list(columns)
+        self.count += 1
+        return record
+
+
+def write_stream(path, frames, duration_ms, keyframe_interval=50):
+    encoder = Encoder(keyframe_interval)
+    total = 0
+    with open(path, "wb") as out:
+        out.write(STREAM_MAGIC)
+        for columns in frames:
+            record = encoder.encode(columns)
+            out.write(struct.pack("<HH", duration_ms, len(record)))
+            out.write(record)
+            total += len(record)
+    return total
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("frames", help="frame file ('#' and '.' rows, blank line between frames)")
+    parser.add_argument("output", help="recorded stream to write")
+    parser.add_argument("--duration", type=int, default=100, help="milliseconds per frame")
+    parser.add_argument("--keyframe-interval", type=int, default=50)
+    args = parser.parse_args()
+
+    frames = parse_frames(args.frames)
+    encoded = write_stream(args.output, frames, args.duration, args.keyframe_interval)
+    raw = len(frames) * PACKED_BYTES
+    print("%d frames, %d bytes encoded, %d bytes raw (%.1fx)" % (len(frames), encoded, raw, raw / max(encoded, 1)))
+
+
+if __name__ == "__main__":
+    main()
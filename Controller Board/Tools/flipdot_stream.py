@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+Stream frames to the flipdot controller over UDP.
+
+Frames are 40x7 and packed into a 35 byte bitstream, bit (x * 7 + y) LSB first,
+matching PackedFrame::packBits on the controller.
+
+Usage:
+  flipdot_stream.py HOST                      # built in scanning demo
+  flipdot_stream.py HOST --file frames.txt    # frames drawn with '#' and '.', blank line between frames
+  flipdot_stream.py HOST --delta              # send XOR deltas between keyframes
+  flipdot_stream.py HOST --codec              # send flipdot_codec records between keyframes
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+WIDTH = 40
+HEIGHT = 7
+PACKED_BYTES = (WIDTH * HEIGHT + 7) // 8
+
+FULL_FRAME = 0
+DELTA_FRAME = 1
+CODED_FRAME = 2
+
+
+def pack_columns(columns):
+    """Pack a list of 40 column bytes (bit y = row y) into the 35 byte bitstream."""
+    value = 0
+    for x, column in enumerate(columns):
+        value |= (column & 0x7F) << (x * HEIGHT)
+    return value.to_bytes(PACKED_BYTES, "little")
+
+
+def parse_frames(path):
+    """Read frames drawn as 7 lines of '#' (on) and '.' (off), separated by blank lines."""
+    frames = []
+    rows = []
+    with open(path) as source:
+        for line in source.read().splitlines() + [""]:
+            if line.strip():
+                rows.append(line)
+                continue
+            if rows:
+                columns = [0] * WIDTH
+                for y, row in enumerate(rows[:HEIGHT]):
+                    for x, char in enumerate(row[:WIDTH]):
+                        if char == "#":
+                            columns[x] |= 1 << y
+                frames.append(columns)
+                rows = []
+    return frames
+
+
+def demo_frames():
+    """A bar sweeping across the panel and back."""
+    positions = list(range(WIDTH)) + list(range(WIDTH - 2, 0, -1))
+    for position in positions:
+        columns = [0] * WIDTH
+        columns[position] = 0x7F
+        yield columns
+
+
+def packet(packet_type, sequence, payload):
+    return b"FD" + struct.pack("<BH", packet_type, sequence & 0xFFFF) + payload
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=4210)
+    parser.add_argument("--fps", type=float, default=20.0)
+    parser.add_argument("--file", help="frame file to play")
+    parser.add_argument("--loop", action="store_true", help="repeat until interrupted")
+    parser.add_argument("--delta", action="store_true", help="send XOR deltas between keyframes")
+    parser.add_argument("--codec", action="store_true", help="send flipdot_codec records")
+    parser.add_argument("--keyframe-interval", type=int, default=25)
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sequence = 0
+    previous = None
+    period = 1.0 / args.fps
+    deadline = time.monotonic()
+
+    encoder = None
+    if args.codec:
+        from flipdot_codec import Encoder
+        encoder = Encoder(args.keyframe_interval)
+
+    while True:
+        frames = parse_frames(args.file) if args.file else demo_frames()
+        for columns in frames:
+            if encoder:
+                sock.sendto(packet(CODED_FRAME, sequence, encoder.encode(columns)), (args.host, args.port))
+            elif args.delta and previous is not None and sequence % args.keyframe_interval:
+                delta = [a ^ b for a, b in zip(columns, previous)]
+                sock.sendto(packet(DELTA_FRAME, sequence, pack_columns(delta)), (args.host, args.port))
+            else:
+                sock.sendto(packet(FULL_FRAME, sequence, pack_columns(columns)), (args.host, args.port))
+            previous = columns
+            sequence += 1
+
+            deadline += period
+            time.sleep(max(0.0, deadline - time.monotonic()))
+        if not args.loop:
+            break
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,166 @@
+#include <avr/io.h>
+#include <avr/xmega.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// SERIAL BOOTLOADER
+// Entered after a software reset (register 15 "BL" broadcast in the application) or when the
+// application image is not valid. Commands are raw 8 bit bytes on the shared bus:
+//
+// 'P' page data[64] crc16      Broadcast page write, crc over page and data. Pages already
+//                              written this session and pages failing the crc are ignored.
+// 'G' pages crc[3]             Start the application if the crc over pages 0..pages-1 as they are
+//                              in flash matches. The image info is kept in the last EEPROM bytes.
+//                              The crc goes in 7 bit groups, low first: every byte stays below 0x80,
+//                              so an application that already started ignores a repeated 'G'.
+//
+// crc16 is CCITT (0x1021, initial 0xFFFF), sent low byte first.
+// The driver's transceiver only receives, so nothing is acknowledged: the controller repeats the
+// whole image and a module still missing a page when 'G' arrives stays here until the next update.
+// The CPU halts while a page is written, the controller waits PAGE_WRITE_MS after each page.
+// A gap inside a packet abandons it, so a lost byte costs one packet rather than desynchronising the rest.
+
+#define BAUD_RATE 115200UL
+
+#define APP_START 0x200  // BOOTEND = 0x02
+#define PAGE_SIZE PROGMEM_PAGE_SIZE
+#define APP_PAGES ((PROGMEM_SIZE - APP_START) / PAGE_SIZE)
+#define BITMAP_BYTES ((APP_PAGES + 7) / 8)
+
+#define INFO_ADDRESS (EEPROM_START + EEPROM_SIZE - 4)  // valid marker, pages, crc low, crc high
+#define INFO_VALID 0xB1
+
+#define RX_TIMEOUT_LOOPS 3000  // About 2ms at 10MHz, bytes inside a packet arrive every 87us
+
+static bool timedOut;  // No startup files: set before use, never relies on .bss clearing
+
+static uint8_t rx(void) {  // Next byte of a packet
+  uint16_t wait = RX_TIMEOUT_LOOPS;
+  while (!timedOut && !(USART0.STATUS & USART_RXCIF_bm)) {
+    if (--wait == 0) {
+      timedOut = true;
+    }
+  }
+  return timedOut ? 0 : USART0.RXDATAL;
+}
+
+static uint16_t crc16(uint16_t crc, uint8_t value) {
+  crc ^= (uint16_t)value << 8;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static uint16_t rxCrc(void) {
+  uint16_t value = rx();
+  return value | (uint16_t)rx() << 8;
+}
+
+static uint16_t rxCrc7(void) {
+  uint16_t value = rx();
+  value |= (uint16_t)rx() << 7;
+  return value | (uint16_t)rx() << 14;
+}
+
+static void nvmCommand(uint8_t command) {  // Commit the page buffer
+  _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, command);
+  while (NVMCTRL.STATUS & (NVMCTRL_FBUSY_bm | NVMCTRL_EEBUSY_bm));
+}
+
+static uint16_t appCrc(uint8_t pages) {
+  const uint8_t* flash = (const uint8_t*)(MAPPED_PROGMEM_START + APP_START);
+  uint16_t crc = 0xFFFF;
+  for (uint16_t i = 0; i < (uint16_t)pages * PAGE_SIZE; i++) {
+    crc = crc16(crc, flash[i]);
+  }
+  return crc;
+}
+
+static bool appValid(void) {
+  const uint8_t* info = (const uint8_t*)INFO_ADDRESS;
+  if (info[0] == 0xFF) {  // Never updated over the bus, trust an application flashed over UPDI
+    return *(const uint16_t*)(MAPPED_PROGMEM_START + APP_START) != 0xFFFF;
+  }
+  return info[0] == INFO_VALID && appCrc(info[1]) == (info[2] | (uint16_t)info[3] << 8);
+}
+
+static void writeInfo(uint8_t marker, uint8_t pages, uint16_t crc) {
+  volatile uint8_t* info = (volatile uint8_t*)INFO_ADDRESS;
+  info[0] = marker;
+  info[1] = pages;
+  info[2] = crc;
+  info[3] = crc >> 8;
+  nvmCommand(NVMCTRL_CMD_PAGEERASEWRITE_gc);
+}
+
+// The reset flags are handed over in GPIOR0 as Optiboot does: the application is built with USING_OPTIBOOT,
+// so its core reads them from there rather than treating the cleared RSTFR as a dirty reset
+static void startApp(uint8_t resetFlags) {
+  USART0.CTRLB = 0;
+  GPIOR0 = resetFlags;
+  ((void (*)(void))(APP_START / 2))();
+}
+
+int main(void) __attribute__((OS_main, section(".init9")));
+
+int main(void) {
+  asm volatile ("clr __zero_reg__");  // No startup files, nothing else sets this up
+
+  uint8_t resetFlags = RSTCTRL.RSTFR;
+  RSTCTRL.RSTFR = resetFlags;
+  if (!(resetFlags & RSTCTRL_SWRF_bm) && appValid()) {
+    startApp(resetFlags);
+  }
+
+  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLB, CLKCTRL_PEN_bm);  // 10 MHz, as the application
+
+  USART0.BAUD = (uint16_t)((4UL * F_CPU + BAUD_RATE / 2) / BAUD_RATE);
+  USART0.CTRLB = USART_RXEN_bm;
+
+  uint8_t received[BITMAP_BYTES];
+  uint8_t page[PAGE_SIZE];
+  bool erased = false;
+  for (uint8_t i = 0; i < BITMAP_BYTES; i++) {
+    received[i] = 0;
+  }
+
+  for (;;) {
+    while (!(USART0.STATUS & USART_RXCIF_bm));
+    uint8_t command = USART0.RXDATAL;
+    timedOut = false;
+
+    if (command == 'P') {
+      uint8_t index = rx();
+      uint16_t crc = crc16(0xFFFF, index);
+      for (uint8_t i = 0; i < PAGE_SIZE; i++) {
+        page[i] = rx();
+        crc = crc16(crc, page[i]);
+      }
+      if (rxCrc() != crc || timedOut || index >= APP_PAGES || (received[index >> 3] & (1 << (index & 7)))) {
+        continue;
+      }
+
+      if (!erased) {  // An interrupted update must not be started
+        writeInfo(0, 0, 0);
+        erased = true;
+      }
+      volatile uint8_t* flash = (volatile uint8_t*)(MAPPED_PROGMEM_START + APP_START + (uint16_t)index * PAGE_SIZE);
+      for (uint8_t i = 0; i < PAGE_SIZE; i++) {
+        flash[i] = page[i];
+      }
+      nvmCommand(NVMCTRL_CMD_PAGEERASEWRITE_gc);
+      received[index >> 3] |= 1 << (index & 7);
+    }
+
+    else if (command == 'G') {
+      uint8_t pages = rx();
+      uint16_t crc = rxCrc7();
+      // The whole image is checked, pages kept from an earlier session count if they match
+      if (!timedOut && pages > 0 && pages <= APP_PAGES && appCrc(pages) == crc) {
+        writeInfo(INFO_VALID, pages, crc);
+        startApp(resetFlags);
+      }
+    }
+  }
+}
@@ -1,16 +1,37 @@
 #include <Arduino.h>
 #include <SPI.h>
+#include <EEPROM.h>
 
 #define MODULE_WIDTH 5
 #define MODULE_HEIGHT 7
 
-#define RCLK 0
-#define SRCLR 6
+#define RCLK 0   // PA4
+#define SRCLR 6  // PB1
+
+#define RCLK_VPORT VPORTA  // Direct port access for the ISRs, keep in sync with the pins above
+#define RCLK_bm PIN4_bm
+#define SRCLR_VPORT VPORTB
+#define SRCLR_bm PIN1_bm
 
 #define ADDR_0 1
 #define ADDR_1 2
 #define ADDR_2 3
 
+#define BAUD_RATE 115200
+#define RX_RING_SIZE 32 // Power of two
+
+#define FRAME_QUEUE_LENGTH 8 // Power of two
+#define TICK_MASK 0x3FFF     // Queue and beacon ticks are 14 bit milliseconds, sent as two 7 bit bytes
+
+#define CALIBRATION_UNIT_SHIFT 6 // Register 12 pulse lengths are in 64 tick (6.4us) units
+#define CALIBRATION_ALL 127      // Register 12 dot selecting a test length for every dot, not stored
+// EEPROM bytes 0 - 34 hold the per-dot lengths (sweep * 7 + step), the bootloader keeps its info in the last 4
+
+//#define PULSE_TRACE // Record per-pulse ISR timing, dumped over serial via register 7
+// Bench only: the dump leaves on USART0 TX (PB2), which is not wired to the bus transceiver (its DI is open),
+// so it is read with a serial adapter on the driver's own PB2 pin. The controller's 'd' command requests it.
+#define TRACE_LENGTH 16
+
 #ifdef MILLIS_USE_TIMERA0 // Uses timer B0
   #error "This sketch takes over TCA0 - please use a different timer for millis"
 #endif
@@ -19,9 +40,50 @@ uint8_t address = 0;
 
 uint32_t registerFrames[35] = {0};
 uint32_t registerBuffer = 0;  
+uint8_t pulseCount = 0;
+
+enum flipOrders {   // Register 8, low 3 bits
+  orderColumns,     // Column by column, the original wipe
+  orderInterleaved, // Checkerboard halves, changes dissolve in rather than wipe
+  orderCentreOut,   // Nearest the module centre first
+  orderCustom       // Permutation written to register 14
+};
+#define ORDER_POLARITY_bm 0x08 // Register 8 flag: flip dots being set before dots being reset
+
+enum shiftDirections { // Register 11 operation, low 2 bits
+  shiftLeft,           // Columns move left, the line enters as the rightmost column
+  shiftRight,          // Columns move right, the line enters as the leftmost column
+  shiftUp,             // Rows move up, the line enters as the bottom row (bit n = column n)
+  shiftDown            // Rows move down, the line enters as the top row
+};
+#define SHIFT_COMMIT_bm 0x04 // Register 11 operation flag: commit once this step is applied
+
+uint8_t flipOrder[35];
+uint8_t customOrder[35];
+uint8_t orderSelection = orderColumns;
 
 uint8_t stateBuffer[5] = {0b01111111};
 uint8_t frameBuffer[5] = {0};
+uint8_t refreshMask[5] = {0};  // Unchanged dots to pulse anyway with the next commit, cleared once used
+uint8_t broadcastBuffer[3] = {0}; // Register 15, accepted on every address: command, two argument bytes
+uint8_t seedBuffer[5] = {0};   // Known panel state from the controller, replaces stateBuffer without pulsing
+uint8_t shiftBuffer[2] = {0};  // Register 11 step: operation, injected line
+uint8_t calibrationBuffer[2] = {0}; // Register 12: dot, pulse length
+uint8_t calibrationOverride = 0;    // Length used for every dot while the controller calibrates, 0 = stored lengths
+uint8_t pulseLength[35];            // Per pulse, in calibration units, 0 = saturationTime
+bool seedPending = false;
+
+struct QueuedFrame {  // Register 13: a frame to commit once the bus clock reaches its tick
+  uint8_t columns[5];
+  uint8_t tickLow;
+  uint8_t tickHigh;
+};
+
+QueuedFrame queueBuffer;
+QueuedFrame frameQueue[FRAME_QUEUE_LENGTH];
+uint8_t queueHead = 0;
+uint8_t queueTail = 0;
+uint16_t clockOffset = 0;  // Added to millis() to give the bus clock set by the sync beacon
 
 const int rowHigh[7] = {1, 2, 3, 20, 19, 18, 17};
 const int rowLow[7] = {11, 10, 9, 28, 27, 25, 26};
@@ -37,30 +99,138 @@ enum flipTimeVolts {
 };
 
 int flipTime = 5100;
-int saturationTime = 5000;
+int saturationTime = 5000; // Longest coil pulse, calibrated dots may use less
 
 bool counterRunning = false;
 int index = 0;
 
-int incomingByte = 0; // for incoming serial data
+uint8_t rxRing[RX_RING_SIZE];
+volatile uint8_t rxHead = 0;
+uint8_t rxTail = 0;
+
 uint8_t selectedRegister = 0;
+uint8_t registerPosition = 0;
 bool moduleActive = false;
-bool frameBufferWrite = true;
-bool fullRedraw = true;
+bool frameBufferWrite = false;
+bool fullRedraw = true;   // Dot state is unknown until the controller seeds it, so the first commit redraws everything
+
+#ifdef PULSE_TRACE
+struct PulseTrace {       // TCA0 ticks are 100ns
+  uint16_t timestamp;     // micros(), low 16 bits
+  uint8_t pulse;          // Pulse index, bit 7 set for the pulse-end (overflow) interrupt
+  uint8_t latency;        // TCA0 ticks between the timer event and ISR entry, saturating
+  uint16_t spiTicks;      // TCA0 ticks spent shifting and latching
+};
+
+PulseTrace traceBuffer[TRACE_LENGTH];
+uint8_t traceHead = 0;
+uint8_t traceCount = 0;
+uint16_t traceSequences = 0;     // Flip sequences started
+uint16_t rxOverruns = 0;         // Bytes lost in the USART before the RX interrupt ran
+uint16_t rxDropped = 0;          // Bytes lost to a full RX ring
+bool traceDumpRequested = false;
+
+void traceRecord(uint8_t pulse, uint16_t latency, uint16_t entryCount) {
+  PulseTrace& entry = traceBuffer[traceHead];
+  entry.timestamp = micros();
+  entry.pulse = pulse;
+  entry.latency = latency > 255 ? 255 : latency;
+  entry.spiTicks = entryCount - TCA0.SINGLE.CNT; // Counting down
+  traceHead = (traceHead + 1) % TRACE_LENGTH;
+  if (traceCount < TRACE_LENGTH) {
+    traceCount ++;
+  }
+}
 
+void uartWrite(const void* data, uint8_t length);
+
+void traceDump() {  // 0xA5, count, sequences, rx overruns, rx dropped, then entries oldest first
+  uint8_t count = traceCount;
+  uint8_t start = (traceHead + TRACE_LENGTH - count) % TRACE_LENGTH;
+  uint8_t header[2] = {0xA5, count};
+  uartWrite(header, sizeof(header));
+  uartWrite(&traceSequences, sizeof(traceSequences));
+  uartWrite(&rxOverruns, sizeof(rxOverruns));
+  uartWrite(&rxDropped, sizeof(rxDropped));
+  for (uint8_t i = 0; i < count; i++) {
+    uartWrite(&traceBuffer[(start + i) % TRACE_LENGTH], sizeof(PulseTrace));
+  }
+  traceCount = 0;
+}
+#endif
 
 
-void shift32(uint32_t registerFrame) {  // Shift 32 bits to registers in 8 bit chunks
-  uint8_t shift = 32U; 
-  do {
-      shift -= 8U;
-      SPI.transfer((uint8_t)(registerFrame >> shift));
-  } while ( shift ) ;
+void uartBegin() {  // USART0 on PB2/PB3 without the Arduino Serial driver, which owns the RX interrupt
+  PORTB.DIRSET = PIN2_bm;
+  USART0.BAUD = (uint16_t)((4UL * F_CPU + BAUD_RATE / 2) / BAUD_RATE);
+  USART0.CTRLA = USART_RXCIE_bm;
+  USART0.CTRLB = USART_RXEN_bm | USART_TXEN_bm;
 }
 
-void clockRegisters() {  // Cycle RCLK pin
-  digitalWrite(RCLK, HIGH);
-  digitalWrite(RCLK, LOW);
+void uartWrite(const void* data, uint8_t length) {  // Blocking, only used outside of flip sequences
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (uint8_t i = 0; i < length; i++) {
+    while (!(USART0.STATUS & USART_DREIF_bm));
+    USART0.TXDATAL = bytes[i];
+  }
+}
+
+bool uartRead(uint8_t& value) {
+  if (rxTail == rxHead) {
+    return false;
+  }
+  value = rxRing[rxTail];
+  rxTail = (rxTail + 1) & (RX_RING_SIZE - 1);
+  return true;
+}
+
+
+
+uint8_t shiftBytes[4];
+volatile uint8_t shiftNext = 4;
+bool shiftPending = false;
+
+void shiftBegin(uint32_t registerFrame) {  // Start shifting 32 bits to the registers, the SPI interrupt sends the tail
+  shiftBytes[0] = registerFrame >> 24;
+  shiftBytes[1] = registerFrame >> 16;
+  shiftBytes[2] = registerFrame >> 8;
+  shiftBytes[3] = registerFrame;
+  SPI0.INTFLAGS = SPI_TXCIF_bm;
+  SPI0.DATA = shiftBytes[0];  // Moves straight to the shift register, freeing the buffer
+  while (!(SPI0.INTFLAGS & SPI_DREIF_bm));
+  SPI0.DATA = shiftBytes[1];
+  shiftNext = 2;
+  shiftPending = true;
+  SPI0.INTCTRL = SPI_DREIE_bm;
+}
+
+void shiftWait() {  // Finish a started shift by polling, for use where the SPI interrupt cannot run
+  if (!shiftPending) {
+    return;
+  }
+  SPI0.INTCTRL = 0;
+  while (shiftNext < 4) {
+    while (!(SPI0.INTFLAGS & SPI_DREIF_bm));
+    SPI0.DATA = shiftBytes[shiftNext++];
+  }
+  while (!(SPI0.INTFLAGS & SPI_TXCIF_bm));
+  shiftPending = false;
+}
+
+inline uint16_t pulseTicks(uint8_t pulse) {  // Coil on time of a scheduled pulse in TCA0 ticks
+  uint8_t length = pulseLength[pulse];
+  return length ? (uint16_t)length << CALIBRATION_UNIT_SHIFT : saturationTime;
+}
+
+inline void clockRegisters() {  // Cycle RCLK pin
+  RCLK_VPORT.OUT |= RCLK_bm;
+  RCLK_VPORT.OUT &= ~RCLK_bm;
+}
+
+inline void clearRegisters() {  // Zero the shift registers and latch, turning every coil off without shifting
+  SRCLR_VPORT.OUT &= ~SRCLR_bm;
+  SRCLR_VPORT.OUT |= SRCLR_bm;
+  clockRegisters();
 }
 
 void registerSet(int segmentX, int segmentY, bool segmentValue) { // Modify register buffer to flip single segment
@@ -80,27 +250,224 @@ void registerSet(int segmentX, int segmentY, bool segmentValue) { // Modify regi
   }
 }
 
-bool genStates() {  // Generate register states to update module
-  bool updateRequired = false;
-  for (int sweep = 0; sweep < 5; sweep++) {
-    for (int step = 0; step < 7; step++) {
+bool genStates() {  // Generate register states to update module, in flip order with unchanged dots left out
+  bool polarityGrouped = orderSelection & ORDER_POLARITY_bm;
+  pulseCount = 0;
+  for (uint8_t pass = 0; pass < 2; pass++) {
+    for (uint8_t i = 0; i < 35; i++) {
+      uint8_t sweep = flipOrder[i] / 7;
+      uint8_t step = flipOrder[i] % 7;
       bool currentValue = bitRead(stateBuffer[sweep], step);
       bool segmentValue = bitRead(frameBuffer[sweep], step);
-      if (currentValue != segmentValue || fullRedraw) {
-        updateRequired = true;
+      if (polarityGrouped && segmentValue != (pass == 0)) {
+        continue;
+      }
+      if (currentValue != segmentValue || fullRedraw || bitRead(refreshMask[sweep], step)) {
+        uint8_t length = calibrationOverride ? calibrationOverride : EEPROM.read(flipOrder[i]);
+        pulseLength[pulseCount] = length < (saturationTime >> CALIBRATION_UNIT_SHIFT) ? length : 0;  // Never longer than uncalibrated, erased reads 0xFF
         registerSet (sweep, step, segmentValue);
-        registerFrames[sweep*7 + step] = registerBuffer;
+        registerFrames[pulseCount++] = registerBuffer;
+        registerBuffer = 0;
         bitWrite(stateBuffer[sweep], step, segmentValue);
       }
-      else {
-        registerFrames[sweep*7 + step] = 0;
+    }
+    if (!polarityGrouped) {
+      break;
+    }
+  }
+  memset(refreshMask, 0, sizeof(refreshMask));
+  return pulseCount > 0;
+}
+
+void buildFlipOrder() {  // Fill flipOrder with the selected permutation of dots (sweep * 7 + step)
+  uint8_t count = 0;
+  switch (orderSelection & 0x07) {
+    case orderInterleaved:
+      for (uint8_t parity = 0; parity < 2; parity++) {
+        for (uint8_t dot = 0; dot < 35; dot++) {
+          if (((dot / 7 + dot % 7) & 1) == parity) {
+            flipOrder[count++] = dot;
+          }
+        }
       }
-      registerBuffer = 0;
+      break;
+
+    case orderCentreOut:
+      for (uint8_t distance = 0; distance <= 13; distance++) {  // Squared distance from (2, 3), at most 4 + 9
+        for (uint8_t dot = 0; dot < 35; dot++) {
+          int8_t dx = dot / 7 - 2;
+          int8_t dy = dot % 7 - 3;
+          if (dx * dx + dy * dy == distance) {
+            flipOrder[count++] = dot;
+          }
+        }
+      }
+      break;
+
+    case orderCustom:
+      memcpy(flipOrder, customOrder, sizeof(flipOrder));
+      count = 35;
+      break;
+  }
+
+  if (count != 35) {  // orderColumns, or anything unknown
+    for (uint8_t dot = 0; dot < 35; dot++) {
+      flipOrder[dot] = dot;
     }
-  } 
-  return updateRequired;
+  }
+}
+
+uint16_t busTick() {
+  return (millis() + clockOffset) & TICK_MASK;
+}
+
+bool tickDue(const QueuedFrame& frame) {  // Ticks up to half the wrap period behind the bus clock are due
+  uint16_t tick = frame.tickLow | frame.tickHigh << 7;
+  return ((busTick() - tick) & TICK_MASK) < (TICK_MASK + 1) / 2;
+}
+
+void queueFrame() {
+  uint8_t next = (queueHead + 1) & (FRAME_QUEUE_LENGTH - 1);
+  if (next != queueTail) {  // A full queue drops the newest frame, the controller never sends that far ahead
+    frameQueue[queueHead] = queueBuffer;
+    queueHead = next;
+  }
+}
+
+bool playQueuedFrame() {  // Move the due frame to frameBuffer, skipping frames already superseded by a later due one
+  if (queueTail == queueHead || !tickDue(frameQueue[queueTail])) {
+    return false;
+  }
+  uint8_t next = (queueTail + 1) & (FRAME_QUEUE_LENGTH - 1);
+  while (next != queueHead && tickDue(frameQueue[next])) {
+    queueTail = next;
+    next = (queueTail + 1) & (FRAME_QUEUE_LENGTH - 1);
+  }
+  memcpy(frameBuffer, frameQueue[queueTail].columns, sizeof(frameBuffer));
+  queueTail = next;
+  return true;
+}
+
+void commitFrame() {
+  queueTail = queueHead;  // An immediate frame replaces anything queued
+  frameBufferWrite = true;
 }
 
+void seedState() {
+  seedPending = true;
+}
+
+void commitFullRedraw() {
+  queueTail = queueHead;
+  frameBufferWrite = true;
+  fullRedraw = true;
+}
+
+void shiftFrame() {  // Move frameBuffer by one column or row, bringing in the received line
+  uint8_t line = shiftBuffer[1];
+  switch (shiftBuffer[0] & 0x03) {
+    case shiftLeft:
+      memmove(frameBuffer, frameBuffer + 1, MODULE_WIDTH - 1);
+      frameBuffer[MODULE_WIDTH - 1] = line;
+      break;
+
+    case shiftRight:
+      memmove(frameBuffer + 1, frameBuffer, MODULE_WIDTH - 1);
+      frameBuffer[0] = line;
+      break;
+
+    case shiftUp:
+      for (uint8_t i = 0; i < MODULE_WIDTH; i++) {
+        frameBuffer[i] = (frameBuffer[i] >> 1) | (bitRead(line, i) << (MODULE_HEIGHT - 1));
+      }
+      break;
+
+    case shiftDown:
+      for (uint8_t i = 0; i < MODULE_WIDTH; i++) {
+        frameBuffer[i] = ((frameBuffer[i] << 1) & 0x7F) | bitRead(line, i);
+      }
+      break;
+  }
+  if (shiftBuffer[0] & SHIFT_COMMIT_bm) {
+    commitFrame();
+  }
+}
+
+void storeCalibration() {
+  uint8_t dot = calibrationBuffer[0];
+  if (dot == CALIBRATION_ALL) {
+    calibrationOverride = calibrationBuffer[1];
+  }
+  else if (dot < 35) {
+    EEPROM.update(dot, calibrationBuffer[1]);  // Takes about 4ms, the controller paces calibration writes
+  }
+}
+
+void selectFlipOrder() {
+  if ((orderSelection & 0x07) == orderCustom) {
+    orderSelection = (orderSelection & ORDER_POLARITY_bm) | orderColumns;  // Only reachable through register 14
+  }
+  buildFlipOrder();
+}
+
+void loadCustomOrder() {  // Accept the register 14 permutation only if every dot appears once
+  uint8_t seen[5] = {0};
+  for (uint8_t i = 0; i < 35; i++) {
+    uint8_t dot = customOrder[i];
+    if (dot >= 35 || bitRead(seen[dot / 7], dot % 7)) {
+      return;
+    }
+    bitSet(seen[dot / 7], dot % 7);
+  }
+  orderSelection = (orderSelection & ORDER_POLARITY_bm) | orderCustom;
+  buildFlipOrder();
+}
+
+void broadcastCommand() {
+  if (broadcastBuffer[0] == 'B' && broadcastBuffer[1] == 'L') {  // Restart into the serial bootloader
+    _PROTECTED_WRITE(RSTCTRL.SWRR, RSTCTRL_SWRE_bm);
+  }
+  else if (broadcastBuffer[0] == 'S') {  // Sync beacon, every module hears the last byte at the same moment
+    clockOffset = (broadcastBuffer[1] | broadcastBuffer[2] << 7) - millis();
+  }
+}
+
+#ifdef PULSE_TRACE
+void requestTraceDump() {
+  traceDumpRequested = true;
+}
+#endif
+
+struct RegisterEntry {
+  uint8_t* target;   // Data bytes are stored here, nullptr for strobe registers
+  uint8_t length;    // Bytes in target before wrapping to the start, 0 for strobe registers
+  uint8_t offset;    // Position of the first data byte after selection
+  void (*action)();  // Called on selection for strobe registers, when target fills otherwise
+};
+
+const RegisterEntry registerTable[16] = {
+  {frameBuffer, 5, 0, nullptr},
+  {frameBuffer, 5, 1, nullptr},
+  {frameBuffer, 5, 2, nullptr},
+  {frameBuffer, 5, 3, nullptr},
+  {frameBuffer, 5, 4, nullptr},
+  {nullptr, 0, 0, commitFrame},
+  {nullptr, 0, 0, commitFullRedraw},
+#ifdef PULSE_TRACE
+  {nullptr, 0, 0, requestTraceDump},
+#else
+  {nullptr, 0, 0, nullptr},
+#endif
+  {&orderSelection, 1, 0, selectFlipOrder},
+  {refreshMask, 5, 0, nullptr},
+  {seedBuffer, 5, 0, seedState},
+  {shiftBuffer, 2, 0, shiftFrame},
+  {calibrationBuffer, 2, 0, storeCalibration},
+  {(uint8_t*)&queueBuffer, sizeof(QueuedFrame), 0, queueFrame},
+  {customOrder, 35, 0, loadCustomOrder},
+  {broadcastBuffer, 3, 0, broadcastCommand},
+};
+
 void setup() {
   _PROTECTED_WRITE(CLKCTRL_MCLKCTRLB, CLKCTRL_PEN_bm);  // Set 10 MHz clock
 
@@ -111,11 +478,15 @@ void setup() {
   pinMode(ADDR_1, INPUT_PULLUP);
   pinMode(ADDR_2, INPUT_PULLUP);
 
+  buildFlipOrder();
+
   address = digitalRead(ADDR_0) | digitalRead(ADDR_1) << 1 | digitalRead(ADDR_2) << 2;
 
   digitalWrite(SRCLR, HIGH);
   SPI.begin();
-  Serial.begin(115200);
+  SPI0.CTRLA = SPI_MASTER_bm | SPI_CLK2X_bm | SPI_PRESC_DIV4_gc | SPI_ENABLE_bm;  // 5MHz, a frame shifts in 6.4us
+  SPI0.CTRLB = SPI_BUFEN_bm | SPI_SSD_bm | SPI_MODE_0_gc;  // Buffered mode for the DREIF interrupt, RCLK shares the SS pin
+  uartBegin();
 
   takeOverTCA0();
   TCA0.SINGLE.CTRLB = (TCA_SINGLE_WGMODE_NORMAL_gc); //Normal mode counter
@@ -143,69 +514,150 @@ void loop() {
   // Registers 0 - 4: Framebuffer
   // Register 5: Framebuffer Write
   // Register 6: Framebuffer write with full redraw
-
-  while (Serial.available()) {
-    incomingByte = Serial.read();
-
-    if (bitRead(incomingByte, 7)) {
-      if ((incomingByte & 0b01110000) >> 4 == address) {
-        moduleActive = true;
+  // Register 7: Dump pulse trace (PULSE_TRACE builds only, out of the PB2 pin rather than the bus)
+  // Register 8: Flip order, 0bPOOO - P = set dots before reset dots, OOO = flipOrders
+  // Register 9: Refresh mask, 5 column bytes of unchanged dots to re-pulse with the next commit
+  // Register 10: Seed state, 5 column bytes the dots are known to show, nothing is pulsed
+  // Register 11: Shift, pairs of operation 0b0CDD and line. Each pair moves the framebuffer one step in direction DD
+  //   (shiftDirections) and fills the vacated column or row with line, C = commit after this step
+  // Register 12: Calibration, dot then pulse length in 6.4us units, stored in EEPROM. 0 = uncalibrated, lengths are
+  //   capped at saturationTime. Dot 127 sets a length for every dot until cleared with 0, without storing it
+  // Register 13: Queue frame, 5 column bytes then tick low, tick high. Committed once the bus clock reaches the tick,
+  //   registers 5 and 6 discard the queue
+  // Register 14: Custom flip order, 35 dot indices (sweep * 7 + step)
+  // Register 15: Broadcast, any address. 3 bytes: command, argument, argument
+  //   'B' 'L' x - restart into the bootloader (Driver Board/Bootloader)
+  //   'S' low high - sync beacon, sets the bus clock to the 14 bit millisecond tick
+
+  uint8_t incomingByte;
+  while (uartRead(incomingByte)) {
+    if (incomingByte & 0x80) {
+      moduleActive = ((incomingByte >> 4) & 0b0111) == address || (incomingByte & 0b00001111) == 15;
+      if (moduleActive) {
         selectedRegister = incomingByte & 0b00001111;
-
-        if (selectedRegister == 5) {
-          frameBufferWrite = true;
+        const RegisterEntry& entry = registerTable[selectedRegister];
+        registerPosition = entry.offset;
+        if (entry.length == 0) { // Strobe register, acts on selection
           moduleActive = false;
+          if (entry.action) {
+            entry.action();
+          }
         }
-
-        if (selectedRegister == 6) {
-          frameBufferWrite = true;
-          fullRedraw = true;
-          moduleActive = false;
-        }
-      }
-      else {
-        moduleActive = false;
       }
     }
     else if (moduleActive) {
-      if (selectedRegister >= 0 && selectedRegister <= 4) {
-        for (int y = 0; y < 7; y ++) {
-          frameBuffer[selectedRegister] = incomingByte;
-        }
-        selectedRegister ++;
-        if (selectedRegister > 4) {
-          selectedRegister = 0;
+      const RegisterEntry& entry = registerTable[selectedRegister];
+      entry.target[registerPosition++] = incomingByte;
+      if (registerPosition >= entry.length) {
+        registerPosition = 0;
+        if (entry.action) {
+          entry.action();
         }
       }
     }
   }
 
+  if (!counterRunning && seedPending) {
+    seedPending = false;
+    if (fullRedraw) { // Only while our own state is unknown, a controller restart must not overwrite what we know
+      memcpy(stateBuffer, seedBuffer, sizeof(stateBuffer));
+      fullRedraw = false;
+    }
+  }
+
+  if (!counterRunning && !frameBufferWrite && playQueuedFrame()) {
+    frameBufferWrite = true;
+  }
+
   if (!counterRunning && frameBufferWrite){
     frameBufferWrite = false;
-    genStates();
+    bool updateRequired = genStates();
     fullRedraw = false;
-    TCA0.SINGLE.CNT = flipTime;
-    counterRunning = true;
-    index = 0;
-    TCA0.SINGLE.CTRLA = TCA_SINGLE_ENABLE_bm;
+    if (updateRequired) {
+      uint16_t ticks = pulseTicks(0);
+      TCA0.SINGLE.PER = ticks + flipTime - saturationTime;  // Later pulses are loaded through PERBUF and CMP0BUF
+      TCA0.SINGLE.CMP0 = ticks;
+      TCA0.SINGLE.CNT = ticks + flipTime - saturationTime;
+      counterRunning = true;
+      index = 0;
+      shiftBegin(registerFrames[0]);  // Shifted in before the first compare, 10us away
+      TCA0.SINGLE.CTRLA = TCA_SINGLE_ENABLE_bm;
+      #ifdef PULSE_TRACE
+        traceSequences ++;
+      #endif
+    }
   }
+
+  #ifdef PULSE_TRACE
+    if (traceDumpRequested && !counterRunning) {
+      traceDumpRequested = false;
+      traceDump();
+    }
+  #endif
 }
 
 
-ISR(TCA0_OVF_vect) {    // on overflow, shift out 0 and enter recovery time
-  if (index >= 35) {
+ISR(TCA0_OVF_vect) {    // on overflow, turn the coils off and shift in the next pixel during the recovery time
+  #ifdef PULSE_TRACE
+    uint16_t entryCount = TCA0.SINGLE.CNT;
+  #endif
+  clearRegisters();
+  if (index >= pulseCount) {
     TCA0.SINGLE.CTRLA = 0;
     counterRunning = false;
   }
-  shift32(0x00); 
-  clockRegisters();
+  else {
+    shiftBegin(registerFrames[index]);
+  }
+  #ifdef PULSE_TRACE
+    traceRecord(0x80 | (index - 1), TCA0.SINGLE.PER - entryCount, entryCount);
+  #endif
   TCA0.SINGLE.INTFLAGS  = TCA_SINGLE_OVF_bm; // Always remember to clear the interrupt flags, otherwise the interrupt will fire continually!
 }
 
 
-ISR(TCA0_CMP0_vect) {    // on compare, get next pixel and set state
-  shift32(registerFrames[index]);
+ISR(TCA0_CMP0_vect) {    // on compare, latch the pixel shifted in during recovery and queue the next pulse's timing
+  #ifdef PULSE_TRACE
+    uint16_t entryCount = TCA0.SINGLE.CNT;
+  #endif
+  shiftWait();
   clockRegisters();
+  #ifdef PULSE_TRACE
+    traceRecord(index, TCA0.SINGLE.CMP0 - entryCount, entryCount);
+  #endif
   index ++;
+  if (index < pulseCount) {  // Timing for the next pulse, taking effect when this one ends
+    uint16_t ticks = pulseTicks(index);
+    TCA0.SINGLE.PERBUF = ticks + flipTime - saturationTime;
+    TCA0.SINGLE.CMP0BUF = ticks;
+  }
   TCA0.SINGLE.INTFLAGS  = TCA_SINGLE_CMP0_bm; // Always remember to clear the interrupt flags, otherwise the interrupt will fire continually!
-}
\ No newline at end of file
+}
+
+
+ISR(SPI0_INT_vect) {    // transmit buffer empty, feed the next byte of the frame being shifted
+  SPI0.DATA = shiftBytes[shiftNext++];
+  if (shiftNext >= 4) {
+    SPI0.INTCTRL = 0;
+  }
+}
+
+
+ISR(USART0_RXC_vect) {    // queue received bytes for the parser in loop()
+  #ifdef PULSE_TRACE
+    if (USART0.RXDATAH & USART_BUFOVF_bm) {
+      rxOverruns ++;
+    }
+  #endif
+  uint8_t value = USART0.RXDATAL;
+  uint8_t next = (rxHead + 1) & (RX_RING_SIZE - 1);
+  if (next != rxTail) {
+    rxRing[rxHead] = value;
+    rxHead = next;
+  }
+  #ifdef PULSE_TRACE
+    else {
+      rxDropped ++;
+    }
+  #endif
+}
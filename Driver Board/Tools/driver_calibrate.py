@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""
+Find the shortest reliable coil pulse for every dot of a driver module and
+store it in the driver's EEPROM (register 12), through the controller's
+serial console ('c' commands, see DriverCalibrator).
+
+  driver_calibrate.py sweep /dev/ttyUSB0 --module 3 [--start 74] [--stop 20] [--step 4] [--margin 2] [--output m3.json] [--write]
+      Flip the whole module on and off with shorter and shorter pulses. After
+      each flip, type the dots that did not follow as column,row pairs
+      ("0,3 4,6") or press enter if all of them did. A dot's length is the
+      last one it passed at in both directions plus the margin.
+
+  driver_calibrate.py apply /dev/ttyUSB0 m3.json
+      Store a saved table again, e.g. after replacing the driver board.
+
+  driver_calibrate.py clear /dev/ttyUSB0 --module 3
+      Return every dot of the module to the uncalibrated pulse.
+
+Lengths are in 6.4 us units (64 TCA0 ticks). 0 and anything from the
+uncalibrated 78 (500 us) up means uncalibrated. Needs pyserial.
+"""
+
+import argparse
+import json
+import sys
+
+from driver_emulator import CALIBRATION_UNIT_SHIFT, FLIP_TIME, MODULE_HEIGHT, MODULE_WIDTH, PULSES, SATURATION_TIME, TICK_NS, pulse_ticks
+
+UNCALIBRATED = SATURATION_TIME >> CALIBRATION_UNIT_SHIFT
+UNIT_US = (1 << CALIBRATION_UNIT_SHIFT) * TICK_NS / 1000
+
+
+class Console:
+    """Controller serial console, one 'c' command per line, each answered "ok" or "error"."""
+
+    def __init__(self, port):
+        import serial
+
+        self.connection = serial.Serial(port, 115200, timeout=2)
+
+    def command(self, line):
+        self.connection.write(("c%s\n" % line).encode())
+        while True:
+            reply = self.connection.readline().decode(errors="replace").strip()
+            if reply in ("ok", "error"):
+                break
+            if not reply:
+                raise SystemExit("no reply to '%s'" % line)
+        if reply != "ok":
+            raise SystemExit("controller rejected '%s'" % line)
+
+    def store(self, module, lengths):
+        self.command("b")
+        try:
+            for dot, length in enumerate(lengths):
+                self.command("s %d %d %d" % (module, dot, length))
+        finally:
+            self.command("e")
+
+
+def parse_dots(text):
+    dots = set()
+    for pair in text.split():
+        column, row = (int(value) for value in pair.split(","))
+        if not (0 <= column < MODULE_WIDTH and 0 <= row < MODULE_HEIGHT):
+            raise ValueError(pair)
+        dots.add(column * MODULE_HEIGHT + row)
+    return dots
+
+
+def ask_failures(prompt):
+    while True:
+        try:
+            return parse_dots(input(prompt))
+        except ValueError as error:
+            print("  not a column,row pair: %s" % error)
+
+
+def fit_lengths(passed, margin):
+    """Stored length per dot from the shortest length each passed at, capped at uncalibrated."""
+    lengths = []
+    for dot in range(PULSES):
+        length = passed.get(dot, UNCALIBRATED) + margin
+        lengths.append(length if length < UNCALIBRATED else 0)
+    return lengths
+
+
+def sequence_ms(lengths):
+    recovery = FLIP_TIME - SATURATION_TIME
+    return sum(pulse_ticks(dot, lengths) + recovery for dot in range(PULSES)) * TICK_NS / 1e6
+
+
+def sweep(console, module, start, stop, step, margin):
+    passed = {}  # Shortest length each dot has flipped reliably at so far
+    failed = set()
+    console.command("b")
+    try:
+        for length in range(min(start, UNCALIBRATED - 1), stop - 1, -step):
+            print("length %d (%.1f us)" % (length, length * UNIT_US))
+            failures = set()
+            for on in (1, 0):
+                console.command("t %d %d %d" % (module, length, on))
+                failures |= ask_failures("  dots still %s: " % ("off" if on else "on"))
+            for dot in range(PULSES):
+                if dot in failed:
+                    continue
+                if dot in failures:
+                    failed.add(dot)
+                else:
+                    passed[dot] = length
+            if len(failed) == PULSES:
+                break
+    finally:
+        console.command("e")
+    return fit_lengths(passed, margin)
+
+
+def print_table(lengths):
+    for row in range(MODULE_HEIGHT):
+        print("  " + " ".join("%3s" % (lengths[column * MODULE_HEIGHT + row] or "-") for column in range(MODULE_WIDTH)))
+    print("full module redraw %.2f ms, uncalibrated %.2f ms" % (sequence_ms(lengths), sequence_ms(None)))
+
+
+def load_table(path):
+    with open(path) as source:
+        table = json.load(source)
+    lengths = table["lengths"]
+    if len(lengths) != PULSES or not all(0 <= length < 128 for length in lengths):
+        raise SystemExit("%s does not hold %d lengths" % (path, PULSES))
+    return table["module"], lengths
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    sweep_parser = commands.add_parser("sweep")
+    sweep_parser.add_argument("port")
+    sweep_parser.add_argument("--module", type=int, required=True)
+    sweep_parser.add_argument("--start", type=int, default=UNCALIBRATED - 4)
+    sweep_parser.add_argument("--stop", type=int, default=20)
+    sweep_parser.add_argument("--step", type=int, default=4)
+    sweep_parser.add_argument("--margin", type=int, default=2, help="units added to the shortest passing length")
+    sweep_parser.add_argument("--output", help="save the table as JSON")
+    sweep_parser.add_argument("--write", action="store_true", help="store the table in the driver")
+
+    apply_parser = commands.add_parser("apply")
+    apply_parser.add_argument("port")
+    apply_parser.add_argument("table")
+
+    clear_parser = commands.add_parser("clear")
+    clear_parser.add_argument("port")
+    clear_parser.add_argument("--module", type=int, required=True)
+
+    args = parser.parse_args()
+    console = Console(args.port)
+    if args.command == "sweep":
+        lengths = sweep(console, args.module, args.start, args.stop, args.step, args.margin)
+        print_table(lengths)
+        if args.output:
+            with open(args.output, "w") as out:
+                json.dump({"module": args.module, "unit_us": UNIT_US, "lengths": lengths}, out)
+        if args.write:
+            console.store(args.module, lengths)
+    elif args.command == "apply":
+        module, lengths = load_table(args.table)
+        console.store(module, lengths)
+        print_table(lengths)
+    elif args.command == "clear":
+        console.store(args.module, [0] * PULSES)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,345 @@
+#!/usr/bin/env python3
+"""
+Host-side model of the driver board firmware (Driver Board/Firmware/src/main.cpp).
+
+  driver_emulator.py timeline [--full] [--old HEX] [--new HEX] [--order N] [--refresh HEX] [--calibration LIST]
+      Emulate genStates() and the TCA0 compare/overflow ISRs for one frame
+      update and print when each coil pulse is actually latched on and off.
+      --calibration gives register 12 pulse lengths, one for every dot or 35
+      comma separated (sweep * 7 + step), as written by driver_calibrate.py.
+
+  driver_emulator.py order [--old HEX] [--new HEX] [--polarity] [--custom LIST]
+      Compare the register 8 flip orders for one frame update: pulse map,
+      how scattered consecutive pulses are, how soon every changed column
+      shows movement, and the supply current profile.
+
+  driver_emulator.py decode trace.bin
+      Decode a pulse trace dump (register 7 on a PULSE_TRACE build, requested
+      with the controller's 'd' command). The bus cannot carry it back: capture
+      it with a 115200 baud serial adapter on the driver's TX pin (PB2).
+
+Bootloader models Driver Board/Bootloader for driver_update.py.
+
+Frames are given as 5 column bytes in hex, e.g. --new 7f00000000.
+"""
+
+import argparse
+import struct
+import sys
+
+F_CPU = 10_000_000
+TICK_NS = 100                    # TCA0 counts at F_CPU, 100 ns per tick
+
+FLIP_TIME = 5100                 # TCA0 PER
+SATURATION_TIME = 5000           # TCA0 CMP0, counting down from PER
+CALIBRATION_UNIT_SHIFT = 6       # Register 12 lengths are in 64 tick units
+
+SPI_CLOCK = F_CPU // 2           # CLK2X with DIV4, buffered mode
+SHIFT_BEGIN_CYCLES = 30          # shiftBegin(): byte split, first two DATA writes, DREIE enable
+SPI_ISR_CYCLES = 40              # SPI0_INT_vect feeding one byte, entry to exit
+ISR_ENTRY_CYCLES = 24            # Vector, prologue and register pushes
+ISR_EXIT_CYCLES = 20
+PORT_WRITE_CYCLES = 1            # VPORT sbi/cbi
+SHIFT_WAIT_CYCLES = 12           # shiftWait() when the shift already finished
+
+MODULE_WIDTH = 5
+MODULE_HEIGHT = 7
+PULSES = MODULE_WIDTH * MODULE_HEIGHT
+
+ORDER_COLUMNS = 0
+ORDER_INTERLEAVED = 1
+ORDER_CENTRE_OUT = 2
+ORDER_CUSTOM = 3
+ORDER_POLARITY = 0x08
+ORDER_NAMES = {ORDER_COLUMNS: "columns", ORDER_INTERLEAVED: "interleaved", ORDER_CENTRE_OUT: "centre-out", ORDER_CUSTOM: "custom"}
+
+COIL_CURRENT = 0.4               # Amps through one coil during a pulse, depends on supply voltage
+
+
+def cycles_to_ns(cycles):
+    return cycles * 1_000_000_000 // F_CPU
+
+
+def spi_shift_ns():
+    """Time for the SPI peripheral to clock 32 bits out once shiftBegin() has loaded it."""
+    return 32 * 1_000_000_000 // SPI_CLOCK
+
+
+def off_latch_ns():
+    """OVF entry until clearRegisters() has latched zeros: SRCLR low, high, RCLK high."""
+    return cycles_to_ns(ISR_ENTRY_CYCLES + 3 * PORT_WRITE_CYCLES)
+
+
+def shift_done_ns():
+    """OVF entry until the next pixel is fully in the shift registers."""
+    return off_latch_ns() + cycles_to_ns(PORT_WRITE_CYCLES + SHIFT_BEGIN_CYCLES) + spi_shift_ns()
+
+
+def on_latch_ns(compare_ns):
+    """CMP0 entry until RCLK rises, given the shift started at the previous overflow compare_ns earlier."""
+    entry = cycles_to_ns(ISR_ENTRY_CYCLES)
+    # The SPI interrupt cannot run inside the CMP0 ISR, shiftWait() polls out what is left
+    ready = max(entry + cycles_to_ns(SHIFT_WAIT_CYCLES), shift_done_ns() - compare_ns + cycles_to_ns(SPI_ISR_CYCLES))
+    return ready + cycles_to_ns(PORT_WRITE_CYCLES)
+
+
+def isr_ns():
+    """Longest TCA0 ISR: OVF with clear, latch and shiftBegin()."""
+    return off_latch_ns() + cycles_to_ns(2 * PORT_WRITE_CYCLES + SHIFT_BEGIN_CYCLES + ISR_EXIT_CYCLES)
+
+
+def flip_order(selection, custom=None):
+    """buildFlipOrder(): the permutation of dots (sweep * 7 + step) for a register 8 value."""
+    order = selection & 0x07
+    if order == ORDER_INTERLEAVED:
+        return [dot for parity in (0, 1) for dot in range(PULSES) if (dot // 7 + dot % 7) & 1 == parity]
+    if order == ORDER_CENTRE_OUT:
+        return [dot for distance in range(14) for dot in range(PULSES) if (dot // 7 - 2) ** 2 + (dot % 7 - 3) ** 2 == distance]
+    if order == ORDER_CUSTOM and custom is not None and sorted(custom) == list(range(PULSES)):
+        return list(custom)
+    return list(range(PULSES))
+
+
+def pulse_ticks(dot, calibration):
+    """Coil on time genStates() and pulseTicks() give a dot, in TCA0 ticks."""
+    length = calibration[dot] if calibration else 0
+    if length == 0 or length >= SATURATION_TIME >> CALIBRATION_UNIT_SHIFT:
+        return SATURATION_TIME
+    return length << CALIBRATION_UNIT_SHIFT
+
+
+def gen_states(state, frame, full_redraw, selection=ORDER_COLUMNS, custom=None, refresh=None):
+    """Return the pulses genStates() schedules, in order: (dot, column, row, value)."""
+    refresh = refresh or [0] * MODULE_WIDTH
+    order = flip_order(selection, custom)
+    passes = (1, 0) if selection & ORDER_POLARITY else (None,)
+    pulses = []
+    for polarity in passes:
+        for dot in order:
+            sweep, step = divmod(dot, MODULE_HEIGHT)
+            current = (state[sweep] >> step) & 1
+            target = (frame[sweep] >> step) & 1
+            if polarity is not None and target != polarity:
+                continue
+            if current != target or full_redraw or (refresh[sweep] >> step) & 1:
+                pulses.append((dot, sweep, step, target))
+    return pulses
+
+
+def timeline(state, frame, full_redraw, selection=ORDER_COLUMNS, custom=None, refresh=None, calibration=None):
+    """Emulate the TCA0 sequence. Returns a list of (slot, pulse, on_ns, off_ns)."""
+    events = []
+    recovery_ns = (FLIP_TIME - SATURATION_TIME) * TICK_NS  # Each period is the pulse plus this, PER = CMP0 + recovery
+
+    period_start = 0
+    for slot, pulse in enumerate(gen_states(state, frame, full_redraw, selection, custom, refresh)):
+        period_ns = recovery_ns + pulse_ticks(pulse[0], calibration) * TICK_NS
+        if slot == 0:
+            on = recovery_ns + cycles_to_ns(ISR_ENTRY_CYCLES + SHIFT_WAIT_CYCLES + PORT_WRITE_CYCLES)  # Shifted before the timer starts
+        else:
+            on = period_start + recovery_ns + on_latch_ns(recovery_ns)
+        off = period_start + period_ns + off_latch_ns()
+        events.append((slot, pulse, on, off))
+        period_start += period_ns
+    return events
+
+
+def print_order(state, frame, selection, custom):
+    events = timeline(state, frame, False, selection, custom)
+    name = ORDER_NAMES[selection & 0x07] + (" +polarity" if selection & ORDER_POLARITY else "")
+    print(name)
+    if not events:
+        print("  no dots change")
+        return
+
+    slots = {}
+    for slot, (dot, _, _, _), _, _ in events:
+        slots[dot] = slot
+    symbols = "0123456789abcdefghijklmnopqrstuvwxyz"
+    for row in range(MODULE_HEIGHT):
+        cells = [symbols[slots[column * MODULE_HEIGHT + row]] if column * MODULE_HEIGHT + row in slots else "." for column in range(MODULE_WIDTH)]
+        print("  " + " ".join(cells))
+
+    pulses = [pulse for _, pulse, _, _ in events]
+    steps = [abs(a[1] - b[1]) + abs(a[2] - b[2]) for a, b in zip(pulses, pulses[1:])]
+    scatter = sum(steps) / len(steps) if steps else 0.0
+    columns = {pulse[1] for pulse in pulses}
+    seen = set()
+    every_column_ns = 0
+    for _, pulse, on, _ in events:
+        seen.add(pulse[1])
+        if seen == columns:
+            every_column_ns = on
+            break
+
+    duration_ns = events[-1][3]
+    pulse_ns = sum(off - on for _, _, on, off in events)
+    print("  %d pulses over %.2f ms, every changed column moving by %.2f ms" % (len(events), duration_ns / 1e6, every_column_ns / 1e6))
+    print("  mean distance between consecutive pulses %.2f dots (1.00 is a wipe)" % scatter)
+    print("  supply %.2f A peak, %.3f A average over the sequence" % (COIL_CURRENT, COIL_CURRENT * pulse_ns / duration_ns))
+
+
+def print_timeline(events):
+    print("slot  dot      value  on (us)     off (us)    width (us)")
+    widths = []
+    for slot, pulse, on, off in events:
+        _, column, row, value = pulse
+        width = off - on
+        widths.append(width)
+        print("%4d  (%d,%d)    %d      %9.2f   %9.2f   %8.2f" % (slot, column, row, value, on / 1000, off / 1000, width / 1000))
+
+    total = events[-1][3] if events else 0
+    print()
+    print("pulses %d of %d, sequence %.2f ms" % (len(widths), PULSES, total / 1_000_000))
+    print("ISR at most %.2f us, SPI shift %.2f us of %.2f us recovery" % (isr_ns() / 1000, (shift_done_ns() - off_latch_ns()) / 1000, (FLIP_TIME - SATURATION_TIME) * TICK_NS / 1000))
+    if widths:
+        print("coil pulse width min %.2f us, max %.2f us" % (min(widths) / 1000, max(widths) / 1000))
+
+
+def decode_trace(data):
+    """Decode a register 7 trace dump: 0xA5, count, uint16 sequences, uint16 rx overruns, uint16 rx dropped, entries."""
+    if len(data) < 8 or data[0] != 0xA5:
+        raise ValueError("not a pulse trace dump")
+    count = data[1]
+    sequences, overruns, dropped = struct.unpack_from("<HHH", data, 2)
+    entries = []
+    for i in range(count):
+        offset = 8 + i * 6
+        if offset + 6 > len(data):
+            break
+        timestamp, pulse, latency, spi_ticks = struct.unpack_from("<HBBH", data, offset)
+        entries.append((timestamp, pulse & 0x7F, "off" if pulse & 0x80 else "on", latency, spi_ticks))
+    return sequences, overruns, dropped, entries
+
+
+def print_trace(sequences, overruns, dropped, entries):
+    print("sequences %d, rx overruns %d, rx bytes dropped %d" % (sequences, overruns, dropped))
+    print("time (us)  pulse  edge  latency (us)  spi+latch (us)  delta (us)")
+    previous = None
+    for timestamp, pulse, edge, latency, spi_ticks in entries:
+        delta = "" if previous is None else "%d" % ((timestamp - previous) & 0xFFFF)
+        previous = timestamp
+        print("%9d  %5d  %-4s  %12.1f  %14.1f  %10s" % (timestamp, pulse, edge, latency * TICK_NS / 1000, spi_ticks * TICK_NS / 1000, delta))
+
+
+BOOT_APP_START = 0x200
+BOOT_PAGE_SIZE = 64
+BOOT_APP_PAGES = (4096 - BOOT_APP_START) // BOOT_PAGE_SIZE
+
+
+def crc16(data, crc=0xFFFF):
+    """CCITT crc16 as used by the bootloader."""
+    for value in data:
+        crc ^= value << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+class Bootloader:
+    """Byte level model of the serial bootloader, feed() one byte at a time. It never answers, the bus is one way."""
+
+    def __init__(self, address):
+        self.address = address
+        self.flash = bytearray(b"\xff" * (BOOT_APP_PAGES * BOOT_PAGE_SIZE))
+        self.received = [False] * BOOT_APP_PAGES
+        self.info = None
+        self.running_app = False
+        self.idle = True
+        self._program = self._run()
+        next(self._program)
+
+    def feed(self, value):
+        if not self.running_app:
+            self._program.send(value)
+
+    def gap(self):
+        """The bus went quiet long enough for the receive timeout: abandon a partial packet."""
+        if not self.idle:
+            self._program = self._run()
+            next(self._program)
+
+    def _run(self):
+        while True:
+            self.idle = True
+            command = yield
+            self.idle = False
+            if command == ord("P"):
+                index = yield
+                page = bytearray()
+                for _ in range(BOOT_PAGE_SIZE):
+                    page.append((yield))
+                low = yield
+                high = yield
+                if low | high << 8 != crc16(bytes([index]) + page) or index >= BOOT_APP_PAGES or self.received[index]:
+                    continue
+                self.info = None
+                self.flash[index * BOOT_PAGE_SIZE:(index + 1) * BOOT_PAGE_SIZE] = page
+                self.received[index] = True
+
+            elif command == ord("G"):
+                pages = yield
+                low = yield
+                middle = yield
+                high = yield
+                expected = (low | middle << 7 | high << 14) & 0xFFFF
+                if 0 < pages <= BOOT_APP_PAGES and crc16(self.flash[:pages * BOOT_PAGE_SIZE]) == expected:
+                    self.info = (pages, expected)
+                    self.running_app = True
+
+
+def parse_calibration(text):
+    lengths = [int(length) for length in text.split(",")]
+    if len(lengths) == 1:
+        lengths *= PULSES
+    if len(lengths) != PULSES or not all(0 <= length < 128 for length in lengths):
+        raise argparse.ArgumentTypeError("expected 1 or %d lengths of 0 - 127" % PULSES)
+    return lengths
+
+
+def parse_frame(text):
+    frame = bytes.fromhex(text)
+    if len(frame) != MODULE_WIDTH:
+        raise argparse.ArgumentTypeError("expected %d column bytes" % MODULE_WIDTH)
+    return [column & 0x7F for column in frame]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    timeline_parser = commands.add_parser("timeline")
+    timeline_parser.add_argument("--old", type=parse_frame, default=[0] * MODULE_WIDTH)
+    timeline_parser.add_argument("--new", type=parse_frame, default=[0x7F] * MODULE_WIDTH)
+    timeline_parser.add_argument("--full", action="store_true", help="full redraw (register 6)")
+    timeline_parser.add_argument("--order", type=int, default=ORDER_COLUMNS, help="register 8 value")
+    timeline_parser.add_argument("--refresh", type=parse_frame, help="register 9 refresh mask")
+    timeline_parser.add_argument("--calibration", type=parse_calibration, help="register 12 pulse lengths")
+
+    order_parser = commands.add_parser("order")
+    order_parser.add_argument("--old", type=parse_frame, default=[0] * MODULE_WIDTH)
+    order_parser.add_argument("--new", type=parse_frame, default=[0x7F] * MODULE_WIDTH)
+    order_parser.add_argument("--polarity", action="store_true", help="also set ORDER_POLARITY")
+    order_parser.add_argument("--custom", type=lambda text: [int(dot) for dot in text.split(",")], help="comma separated register 14 permutation")
+
+    decode_parser = commands.add_parser("decode")
+    decode_parser.add_argument("dump")
+
+    args = parser.parse_args()
+    if args.command == "timeline":
+        print_timeline(timeline(args.old, args.new, args.full, args.order, None, args.refresh, args.calibration))
+    elif args.command == "order":
+        polarity = ORDER_POLARITY if args.polarity else 0
+        selections = [ORDER_COLUMNS, ORDER_INTERLEAVED, ORDER_CENTRE_OUT] + ([ORDER_CUSTOM] if args.custom else [])
+        for selection in selections:
+            print_order(args.old, args.new, selection | polarity, args.custom)
+            print()
+    elif args.command == "decode":
+        with open(args.dump, "rb") as source:
+            print_trace(*decode_trace(source.read()))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
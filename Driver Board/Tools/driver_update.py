@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Driver firmware images for the controller's broadcast updater (DriverUpdater).
+
+  driver_update.py image firmware.bin drvfw.bin
+      Build the "drvfw" partition image from a driver application built with the
+      ATtiny424_boot environment (.pio/build/ATtiny424_boot/firmware.bin).
+      esptool.py --chip esp32 write_flash 0x3E0000 drvfw.bin, then send 'u' on the
+      controller's serial console.
+
+  driver_update.py simulate firmware.bin [--modules 8] [--loss 0.001] [--seed 1] [--passes 6]
+      Run the updater's repeated page broadcast against emulated bootloaders
+      with random byte loss on the bus. The bus only carries data to the
+      drivers, so the updater never learns which pages arrived; the simulation
+      reports what its blind passes would have left missing.
+
+Image layout (little endian):
+  "FDB1", uint16 page count, uint16 crc16 of the pages, then the pages padded with 0xFF.
+"""
+
+import argparse
+import random
+import struct
+
+from driver_emulator import BOOT_APP_PAGES, BOOT_PAGE_SIZE, Bootloader, crc16
+
+IMAGE_MAGIC = b"FDB1"
+PARTITION_SIZE = 0x10000
+
+UPDATE_PASSES = 6
+GO_REPEATS = 3
+PAGE_WRITE_MS = 8
+BYTE_US = 87
+GO_GAP_MS = 100
+
+
+def pad_pages(firmware):
+    pages = (len(firmware) + BOOT_PAGE_SIZE - 1) // BOOT_PAGE_SIZE
+    if pages > BOOT_APP_PAGES:
+        raise SystemExit("firmware is %d bytes, the bootloader takes at most %d" % (len(firmware), BOOT_APP_PAGES * BOOT_PAGE_SIZE))
+    return firmware.ljust(pages * BOOT_PAGE_SIZE, b"\xff"), pages
+
+
+def build_image(firmware):
+    padded, pages = pad_pages(firmware)
+    return IMAGE_MAGIC + struct.pack("<HH", pages, crc16(padded)) + padded
+
+
+def go_packet(pages, image_crc):
+    """'G' with the crc in 7 bit groups, safe to repeat once drivers run the new application."""
+    return b"G" + bytes([pages, image_crc & 0x7F, (image_crc >> 7) & 0x7F, image_crc >> 14])
+
+
+def page_packet(padded, page):
+    data = padded[page * BOOT_PAGE_SIZE:(page + 1) * BOOT_PAGE_SIZE]
+    crc = crc16(bytes([page]) + data)
+    return b"P" + bytes([page]) + data + struct.pack("<H", crc)
+
+
+class Bus:
+    """Shared serial bus to emulated bootloaders, dropping each byte per module with probability loss."""
+
+    def __init__(self, modules, loss, rng):
+        self.modules = modules
+        self.loss = loss
+        self.rng = rng
+        self.bytes_sent = 0
+        self.elapsed_ms = 0.0
+
+    def send(self, data):
+        """Send one packet. The updater always pauses afterwards, so each ends with a gap."""
+        self.bytes_sent += len(data)
+        self.elapsed_ms += len(data) * BYTE_US / 1000
+        for module in self.modules:
+            for value in data:
+                if self.rng.random() >= self.loss:
+                    module.feed(value)
+            module.gap()
+
+
+def simulate(firmware, module_count, loss, seed, passes):
+    """Mirror of DriverUpdater::run: every page in every pass, then 'G' a few times."""
+    padded, pages = pad_pages(firmware)
+    image_crc = crc16(padded)
+    modules = [Bootloader(address) for address in range(module_count)]
+    bus = Bus(modules, loss, random.Random(seed))
+
+    for update_pass in range(1, passes + 1):
+        for page in range(pages):
+            bus.send(page_packet(padded, page))
+            bus.elapsed_ms += PAGE_WRITE_MS
+        missing = sum(not module.received[page] for module in modules for page in range(pages))
+        print("pass %d: %d pages still missing across modules" % (update_pass, missing))
+
+    for _ in range(GO_REPEATS):
+        bus.send(go_packet(pages, image_crc))
+        bus.elapsed_ms += GO_GAP_MS
+    updated = [module.address for module in modules if module.running_app and module.flash[:len(padded)] == padded]
+    for module in modules:
+        if not module.running_app:
+            print("driver %d stays in the bootloader" % module.address)
+    print("updated %d of %d modules, %d pages, %d bytes, about %.2f s"
+          % (len(updated), module_count, pages, bus.bytes_sent, bus.elapsed_ms / 1000))
+    return len(updated) == module_count
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    image_parser = commands.add_parser("image")
+    image_parser.add_argument("firmware")
+    image_parser.add_argument("output")
+
+    simulate_parser = commands.add_parser("simulate")
+    simulate_parser.add_argument("firmware")
+    simulate_parser.add_argument("--modules", type=int, default=8)
+    simulate_parser.add_argument("--loss", type=float, default=0.001, help="probability of losing each byte per module")
+    simulate_parser.add_argument("--seed", type=int, default=1)
+    simulate_parser.add_argument("--passes", type=int, default=UPDATE_PASSES)
+
+    args = parser.parse_args()
+    with open(args.firmware, "rb") as source:
+        firmware = source.read()
+
+    if args.command == "image":
+        image = build_image(firmware)
+        if len(image) > PARTITION_SIZE:
+            raise SystemExit("image is %d bytes, partition holds %d" % (len(image), PARTITION_SIZE))
+        with open(args.output, "wb") as out:
+            out.write(image)
+        print("%d pages, crc %04x" % ((len(image) - 8) // BOOT_PAGE_SIZE, crc16(image[8:])))
+    elif args.command == "simulate":
+        return 0 if simulate(firmware, args.modules, args.loss, args.seed, args.passes) else 1
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())